@@ -0,0 +1,111 @@
+/*
+ *  RTI (real-time inference)
+ *  Convert.cpp, converts a timed data file in the text format to the binary columnar format
+ *  The binary format is mapped into memory by rti instead of being parsed, see timed_data.h
+ *  It also converts raw event logs (entity,timestamp,event) into timed strings, see event_log.h
+ *
+ *  Run using:
+ *  ./rti_convert [-t threads] [-s gap_timeout] [-text] input_file output_file
+ *  
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include "timed_data.h"
+#include "event_log.h"
+#include "parallel.h"
+
+using namespace std;
+
+int main(int argc, const char *argv[]){
+	int arg = 1;
+	bool event_input = false;
+	long long gap_timeout = 0;
+	bool text_output = false;
+	while(arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'){
+		if(string(argv[arg]) == "-text"){
+			text_output = true;
+			arg += 1;
+			continue;
+		}
+		if(arg + 1 >= argc) break;
+		if(string(argv[arg]) == "-t") NUM_THREADS = atoi(argv[arg + 1]);
+		else if(string(argv[arg]) == "-s"){
+			event_input = true;
+			gap_timeout = atoll(argv[arg + 1]);
+		}
+		else break;
+		arg += 2;
+	}
+	if(NUM_THREADS < 1) NUM_THREADS = 1;
+	
+	if(argc - arg < 2){
+		cerr << "Usage: ./rti_convert [-t threads] [-s gap_timeout] [-text] input_file... output_file" << endl;
+		cerr << "  threads is the number of threads used, default is the number of cores" << endl;
+		cerr << "  -s reads input_file as an event log (entity,timestamp,event per line) and splits the events" << endl;
+		cerr << "     of every entity into sessions at gaps larger than gap_timeout (0 for one session per entity)" << endl;
+		cerr << "  -text writes output_file in the text format instead of the binary format" << endl;
+		cerr << "  input_file is a file conaining unlabeled timed strings (text format), several files are read as one input" << endl;
+		cerr << "  output_file is the binary columnar file that is written, it can be given to rti instead of the input_file" << endl;
+		return 0;
+	}
+	vector<const char*> input_files(argv + arg, argv + argc - 1);
+	const char* output_file = argv[argc - 1];
+	
+	for(unsigned int i = 0; i < input_files.size(); ++i){
+		ifstream test_file(input_files[i]);
+		if(!test_file.is_open()){
+			cerr << "cannot open " << input_files[i] << endl;
+			return 1;
+		}
+		test_file.close();
+	}
+	
+	if(event_input && text_output){
+		event_log log(input_files, gap_timeout);
+		ofstream output(output_file);
+		log.write_text(output);
+		output.close();
+		if(!output){
+			cerr << "cannot write " << output_file << endl;
+			return 1;
+		}
+		cerr << "wrote " << log.get_num_sessions() << " strings to " << output_file << endl;
+		return 0;
+	}
+	
+	timed_input* in;
+	if(event_input){
+		event_log log(input_files, gap_timeout);
+		in = log.get_input();
+	} else if(input_files.size() == 1){
+		in = new timed_input(input_files[0]);
+	} else {
+		in = new timed_input(input_files);
+	}
+	
+	bool written;
+	if(text_output){
+		ofstream output(output_file);
+		output << in->to_str();
+		output.close();
+		written = (bool)output;
+	} else {
+		written = in->write_binary(output_file);
+	}
+	if(!written){
+		cerr << "cannot write " << output_file << endl;
+		return 1;
+	}
+	cerr << "wrote " << in->get_num_strings() << " strings to " << output_file << endl;
+	delete in;
+	return 0;
+}
@@ -0,0 +1,319 @@
+/*
+ *  RTI (real-time inference)
+ *  Event_log.cpp, the source file for reading raw event logs as timed strings
+ *
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#include "event_log.h"
+#include "parallel.h"
+#include <string.h>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static inline bool is_blank(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+};
+
+/* removes the blanks around the field [begin, end) */
+static inline void trim_field(const char*& begin, const char*& end){
+	while(begin != end && is_blank(*begin)) ++begin;
+	while(end != begin && is_blank(*(end - 1))) --end;
+};
+
+/* reads the timestamp field, returns false if it is not an integer */
+static inline bool scan_timestamp(const char* p, const char* end, long long& value){
+	bool negative = false;
+	if(p != end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		++p;
+	}
+	if(p == end) return false;
+	long long result = 0;
+	for(; p != end; ++p){
+		if(*p < '0' || *p > '9') return false;
+		result = result * 10 + (*p - '0');
+	}
+	value = negative ? -result : result;
+	return true;
+};
+
+/* a part of the log, parsed by one thread into local buffers */
+struct log_chunk{
+	const char* begin;
+	const char* end;
+	bool first;                  // starts at the first line of the log, which can be a header
+	long long first_event;
+
+	symbol_table chunk_entities;
+	symbol_table chunk_events;
+	vector<int> entities;        // numbered in order of first occurrence within the chunk
+	vector<long long> timestamps;
+	vector<int> events;          // numbered in order of first occurrence within the chunk
+	vector<int> entity_numbers;  // chunk entity number -> log entity number
+	vector<int> event_numbers;   // chunk event number -> log event number
+	long long num_skipped;
+
+	/* returns false if the line is malformed */
+	bool parse_line(const char* p, const char* line_end, string& name){
+		const char* entity_end = (const char*)memchr(p, ',', line_end - p);
+		if(entity_end == 0) return false;
+		const char* timestamp_end = (const char*)memchr(entity_end + 1, ',', line_end - entity_end - 1);
+		if(timestamp_end == 0) return false;
+
+		const char* entity = p;
+		const char* timestamp = entity_end + 1;
+		const char* event = timestamp_end + 1;
+		const char* event_end = line_end;
+		trim_field(entity, entity_end);
+		trim_field(timestamp, timestamp_end);
+		trim_field(event, event_end);
+
+		long long time;
+		if(entity == entity_end || event == event_end || !scan_timestamp(timestamp, timestamp_end, time)) return false;
+
+		/* symbol names cannot contain whitespace */
+		name.assign(event, event_end - event);
+		for(unsigned int i = 0; i < name.size(); ++i)
+			if(is_blank(name[i])) name[i] = '_';
+
+		entities.push_back(chunk_entities.insert(entity, entity_end - entity));
+		timestamps.push_back(time);
+		events.push_back(chunk_events.insert(name.data(), name.size()));
+		return true;
+	};
+
+	void operator()(){
+		num_skipped = 0;
+		string name;
+		const char* p = begin;
+		bool first_line = first;
+		while(p != end){
+			const char* line_end = (const char*)memchr(p, '\n', end - p);
+			if(line_end == 0) line_end = end;
+			const char* q = p;
+			while(q != line_end && is_blank(*q)) ++q;
+			if(q != line_end && !parse_line(q, line_end, name) && !first_line) ++num_skipped;
+			if(q != line_end) first_line = false;
+			p = line_end == end ? end : line_end + 1;
+		}
+	};
+};
+
+struct log_chunk_task{
+	vector<log_chunk>& chunks;
+	log_chunk_task(vector<log_chunk>& c) : chunks(c) {};
+	void operator()(int i){ chunks[i](); };
+};
+
+/* copies a parsed chunk into the columns, using the log entity and event numbers */
+struct fill_log_task{
+	vector<log_chunk>& chunks;
+	vector<int>& entity_column;
+	vector<long long>& timestamp_column;
+	vector<int>& event_column;
+	fill_log_task(vector<log_chunk>& c, vector<int>& en, vector<long long>& ts, vector<int>& ev)
+		: chunks(c), entity_column(en), timestamp_column(ts), event_column(ev) {};
+
+	void operator()(int i){
+		log_chunk& chunk = chunks[i];
+		for(unsigned int j = 0; j < chunk.events.size(); ++j){
+			entity_column[chunk.first_event + j] = chunk.entity_numbers[chunk.entities[j]];
+			timestamp_column[chunk.first_event + j] = chunk.timestamps[j];
+			event_column[chunk.first_event + j] = chunk.event_numbers[chunk.events[j]];
+		}
+		vector<int>().swap(chunk.entities);
+		vector<long long>().swap(chunk.timestamps);
+		vector<int>().swap(chunk.events);
+	};
+};
+
+/* splits a log file into NUM_THREADS chunks, the first line of every file can be a header */
+static void add_log_chunks(vector<log_chunk>& chunks, const char* begin, const char* end){
+	int num_chunks = NUM_THREADS;
+	vector<const char*> bounds;
+	split_lines(begin, end, num_chunks, bounds);
+	for(int i = 0; i < num_chunks; ++i){
+		chunks.push_back(log_chunk());
+		chunks.back().begin = bounds[i];
+		chunks.back().end = bounds[i + 1];
+		chunks.back().first = (i == 0);
+	}
+};
+
+/* the entities and events are numbered in order of their first occurrence in the log */
+void event_log::parse_chunks(vector<log_chunk>& chunks){
+	int num_chunks = chunks.size();
+	log_chunk_task parse_task(chunks);
+	parallel_for(num_chunks, parse_task);
+
+	num_events = 0;
+	num_skipped = 0;
+	for(int i = 0; i < num_chunks; ++i){
+		log_chunk& chunk = chunks[i];
+		chunk.first_event = num_events;
+		num_events += chunk.events.size();
+		num_skipped += chunk.num_skipped;
+		for(int j = 0; j < chunk.chunk_entities.size(); ++j){
+			const string& name = chunk.chunk_entities.get_name(j);
+			chunk.entity_numbers.push_back(entities.insert(name.data(), name.size()));
+		}
+		for(int j = 0; j < chunk.chunk_events.size(); ++j){
+			const string& name = chunk.chunk_events.get_name(j);
+			chunk.event_numbers.push_back(events.insert(name.data(), name.size()));
+		}
+	}
+
+	entity_column.resize(num_events);
+	timestamp_column.resize(num_events);
+	event_column.resize(num_events);
+	fill_log_task fill_task(chunks, entity_column, timestamp_column, event_column);
+	parallel_for(num_chunks, fill_task);
+};
+
+/* orders the events of a range of entities by time and splits them into sessions */
+struct session_task{
+	const vector<long long>& order;        // the events grouped by entity, in log order
+	const vector<long long>& entity_start; // entity e has the events order[entity_start[e], entity_start[e + 1])
+	const vector<long long>& timestamps;
+	const vector<int>& events;
+	const vector<int>& range_start;        // range r has the entities [range_start[r], range_start[r + 1])
+	long long gap_timeout;
+
+	vector< vector<int> > lengths;         // the sessions of every range
+	vector< vector<int> > session_events;
+	vector< vector<rti_time> > delays;
+	vector<char> overflow;            // a vector<bool> cannot be written by several threads
+
+	session_task(const vector<long long>& o, const vector<long long>& s, const vector<long long>& t, const vector<int>& e, const vector<int>& r, long long g)
+		: order(o), entity_start(s), timestamps(t), events(e), range_start(r), gap_timeout(g),
+		  lengths(r.size() - 1), session_events(r.size() - 1), delays(r.size() - 1), overflow(r.size() - 1, 0) {};
+
+	void operator()(int r){
+		vector< pair<long long, long long> > entity_events;
+		for(int e = range_start[r]; e < range_start[r + 1]; ++e){
+			/* sorting on (timestamp, position in the log) keeps events with equal timestamps in log order */
+			entity_events.clear();
+			for(long long i = entity_start[e]; i < entity_start[e + 1]; ++i)
+				entity_events.push_back(pair<long long, long long>(timestamps[order[i]], order[i]));
+			sort(entity_events.begin(), entity_events.end());
+
+			for(unsigned int i = 0; i < entity_events.size(); ++i){
+				long long delay = i == 0 ? 0 : entity_events[i].first - entity_events[i - 1].first;
+				if(i == 0 || (gap_timeout > 0 && delay > gap_timeout)){
+					lengths[r].push_back(0);
+					delay = 0;
+				}
+				if((rti_time)delay != delay) overflow[r] = 1;
+				lengths[r].back()++;
+				session_events[r].push_back(events[entity_events[i].second]);
+				delays[r].push_back((rti_time)delay);
+			}
+		}
+	};
+};
+
+void event_log::sessionize(long long gap_timeout){
+	/* counting sort of the events on entity, stable */
+	int num_entities = entities.size();
+	vector<long long> entity_start(num_entities + 1, 0);
+	for(long long i = 0; i < num_events; ++i) entity_start[entity_column[i] + 1]++;
+	for(int e = 0; e < num_entities; ++e) entity_start[e + 1] += entity_start[e];
+	vector<long long> order(num_events);
+	vector<long long> position(entity_start.begin(), entity_start.end() - 1);
+	for(long long i = 0; i < num_events; ++i) order[position[entity_column[i]]++] = i;
+	vector<int>().swap(entity_column);
+
+	/* ranges of entities with about the same number of events */
+	int num_ranges = 4 * NUM_THREADS;
+	vector<int> range_start(1, 0);
+	for(int r = 1; r < num_ranges; ++r){
+		int e = range_start.back();
+		while(e < num_entities && entity_start[e] < (num_events * r) / num_ranges) ++e;
+		range_start.push_back(e);
+	}
+	range_start.push_back(num_entities);
+
+	session_task task(order, entity_start, timestamp_column, event_column, range_start, gap_timeout);
+	parallel_for(num_ranges, task);
+
+	for(int r = 0; r < num_ranges; ++r){
+		if(task.overflow[r] != 0)
+			input_error("delays between events do not fit in the time values of this build, use a gap timeout or the wide build");
+		session_lengths.insert(session_lengths.end(), task.lengths[r].begin(), task.lengths[r].end());
+		session_events.insert(session_events.end(), task.session_events[r].begin(), task.session_events[r].end());
+		session_delays.insert(session_delays.end(), task.delays[r].begin(), task.delays[r].end());
+	}
+	vector<long long>().swap(timestamp_column);
+	vector<int>().swap(event_column);
+};
+
+event_log::event_log(const char* file_name, long long gap_timeout){
+	read_files(vector<const char*>(1, file_name), gap_timeout);
+};
+
+event_log::event_log(const vector<const char*>& file_names, long long gap_timeout){
+	read_files(file_names, gap_timeout);
+};
+
+void event_log::read_files(const vector<const char*>& file_names, long long gap_timeout){
+	num_events = 0;
+	num_skipped = 0;
+
+	int num_files = file_names.size();
+	vector<void*> mapped(num_files, MAP_FAILED);
+	vector<long long> sizes(num_files, 0);
+	vector<string> buffers(num_files);      // the files that cannot be mapped
+	vector<log_chunk> chunks;
+	for(int f = 0; f < num_files; ++f){
+		int fd = open(file_names[f], O_RDONLY);
+		struct stat file_stat;
+		if(fd != -1 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+			mapped[f] = mmap(0, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(fd != -1) close(fd);
+
+		if(mapped[f] != MAP_FAILED){
+			sizes[f] = file_stat.st_size;
+			madvise(mapped[f], sizes[f], MADV_SEQUENTIAL);
+			add_log_chunks(chunks, (const char*)mapped[f], (const char*)mapped[f] + sizes[f]);
+		} else {
+			ifstream str(file_names[f]);
+			buffers[f].assign(istreambuf_iterator<char>(str), istreambuf_iterator<char>());
+			add_log_chunks(chunks, buffers[f].data(), buffers[f].data() + buffers[f].size());
+		}
+	}
+	parse_chunks(chunks);
+	for(int f = 0; f < num_files; ++f)
+		if(mapped[f] != MAP_FAILED) munmap(mapped[f], sizes[f]);
+
+	sessionize(gap_timeout);
+	cerr << "read " << num_events << " events of " << entities.size() << " entities into "
+	     << session_lengths.size() << " sessions";
+	if(num_skipped != 0) cerr << ", skipped " << num_skipped << " malformed lines";
+	cerr << endl;
+};
+
+void event_log::write_text(ostream& str) const{
+	str << session_lengths.size() << " " << events.size() << "\n";
+	long long position = 0;
+	for(unsigned int session = 0; session < session_lengths.size(); ++session){
+		str << session_lengths[session];
+		for(int index = 0; index < session_lengths[session]; ++index, ++position)
+			str << " " << events.get_name(session_events[position]) << " " << session_delays[position];
+		str << "\n";
+	}
+};
+
+timed_input* event_log::get_input() const{
+	return new timed_input(events, session_lengths, session_events, session_delays);
+};
@@ -0,0 +1,83 @@
+/*
+ *  RTI (real-time inference)
+ *  Event_log.h, the header file for reading raw event logs as timed strings
+ *
+ *  An event log has one event per line: entity,timestamp,event
+ *  The entity is any key (a user, a machine, a session id), the timestamp is an integer (e.g. in milliseconds)
+ *  and the event is the symbol name, whitespace inside it is replaced by '_'. A first line without a numeric
+ *  timestamp is taken to be a header and skipped, as are other malformed lines.
+ *
+ *  The events of every entity are ordered by timestamp (events with equal timestamps stay in log order)
+ *  and split into sessions wherever two consecutive events are more than the gap timeout apart
+ *  (a gap timeout of 0 gives a single session per entity). Every session is a timed string, its time
+ *  values are the delays between its events, the first event has delay 0. The sessions are ordered by
+ *  the first occurrence of their entity in the log, and then by time, so the result does not depend on
+ *  the number of threads.
+ *
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#ifndef _EVENT_LOG_H_
+#define _EVENT_LOG_H_
+
+#include "timed_data.h"
+
+struct log_chunk;
+
+class event_log{
+	symbol_table entities;
+	symbol_table events;
+
+	/* the events in log order, released after sessionizing */
+	vector<int> entity_column;
+	vector<long long> timestamp_column;
+	vector<int> event_column;
+	long long num_events;
+	long long num_skipped;
+
+	/* the sessions, their events and delays back to back */
+	vector<int> session_lengths;
+	vector<int> session_events;
+	vector<rti_time> session_delays;
+
+	void parse_chunks(vector<log_chunk>& chunks);
+	void sessionize(long long gap_timeout);
+	void read_files(const vector<const char*>& file_names, long long gap_timeout);
+
+public:
+	/* reads the log using NUM_THREADS threads and splits it into sessions */
+	event_log(const char* file_name, long long gap_timeout);
+	/* reads several logs as one log, as if the files were concatenated (each can start with a header) */
+	event_log(const vector<const char*>& file_names, long long gap_timeout);
+
+	/* writes the sessions in the text format of timed_input */
+	void write_text(ostream& str) const;
+
+	/* the sessions as a timed_input, identical to parsing the output of write_text */
+	timed_input* get_input() const;
+
+	inline int get_num_sessions() const{
+		return session_lengths.size();
+	};
+
+	inline long long get_num_events() const{
+		return num_events;
+	};
+	
+	/* the number of malformed lines that were skipped */
+	inline long long get_num_skipped() const{
+		return num_skipped;
+	};
+
+	inline int get_num_entities() const{
+		return entities.size();
+	};
+};
+
+#endif /* _EVENT_LOG_H_ */
@@ -17,57 +17,59 @@
 #include <assert.h> 
 #include "interval.h"
 
-void split_set(interval_set& intervals, int time){
-	interval_it it = intervals.lower_bound(time);
-	assert(it != intervals.end());
-	assert((*it).second->get_begin() <= time && (*it).second->get_end() > time);
+void split_set(interval_set& intervals, rti_time time){
+	unsigned int index = intervals.find_index(time);
+	interval* in = index == intervals.lower.size() ? &intervals.last : intervals.lower[index].second;
+	assert(in->get_begin() <= time && in->get_end() > time);
 
-	interval* in = (*it).second;
 	interval* new_in = new interval(in->get_begin(), time);
-	
-	
-	tail_it it2 = in->tails.upper_bound(time);
-	new_in->tails.insert(in->tails.begin(), it2);
-	in->tails.erase(in->tails.begin(), it2);
+	in->tails.split(time, new_in->tails);
+	for(tail_it it3 = new_in->tails.begin(); it3 != new_in->tails.end(); ++it3)
+		new_in->size += (*it3).second.get_count();
+	in->size -= new_in->size;
 	in->begin = time + 1;
-	intervals.insert(it, pair<int, interval*>(time, new_in));
+	intervals.lower.insert(intervals.lower.begin() + index, interval_entry(time, new_in));
 };
 
-void undo_split_set(interval_set& intervals, int time){
-	interval_it it = intervals.find(time);
-	assert(it != intervals.end());
+void undo_split_set(interval_set& intervals, rti_time time){
+	unsigned int index = intervals.find_index(time);
+	assert(index < intervals.lower.size() && intervals.lower[index].first == time);
 
-	interval* old_in = (*it).second;
-	++it;
-	assert(it != intervals.end());
-	
-	interval* in = (*it).second;
-	--it;
+	interval* old_in = intervals.lower[index].second;
+	interval* in = index + 1 == intervals.lower.size() ? &intervals.last : intervals.lower[index + 1].second;
 			
-	in->tails.insert(old_in->tails.begin(), old_in->tails.end());
+	in->add_tails(old_in);
 	in->begin = old_in->get_begin();
-	intervals.erase(it);
+	intervals.lower.erase(intervals.lower.begin() + index);
 	
 	delete old_in;
 };
 
+/* makes i_set a single interval [MIN_TIME, MAX_TIME] without tails */
 void create_interval_set(interval_set& i_set){
-	interval *in = new interval(MIN_TIME, MAX_TIME);
-	i_set[in->get_end()] = in;
+	delete_interval_set(i_set);
+	i_set.last = interval(MIN_TIME, MAX_TIME);
+	i_set.last_entry.first = MAX_TIME;
 };
 
+/* deletes the intervals before the last one */
 void delete_interval_set(interval_set& i_set){
-	for(interval_it it = i_set.begin(); it != i_set.end(); ++it)
-		delete (*it).second;
-	i_set.clear();
+	for(unsigned int i = 0; i < i_set.lower.size(); ++i)
+		delete i_set.lower[i].second;
+	i_set.lower.clear();
 };
 
+interval_set::~interval_set(){
+	delete_interval_set(*this);
+};
 
-interval::interval(int b, int e){
+interval::interval(rti_time b, rti_time e){
 	begin = b;
 	end = e;
 	to = 0;
+	size = 0;
 	num_marked = 0;
 	
+	probability = 0.0;
 	undo_to = 0;
 };
@@ -28,55 +28,57 @@
 #define _INTERVAL_H_
 
 
-#include <map>
+#include <vector>
+#include <iterator>
+#include <assert.h>
 #include "tail.h"
+#include "pool.h"
 using namespace std;
 
 class interval;
+class interval_set;
 class timed_state;
 
-typedef map<int, interval*> interval_set;
-typedef map<int, interval*>::iterator interval_it;
-typedef map<int, interval*>::reverse_iterator interval_rit;
-typedef map<int, interval*>::const_iterator const_interval_it;
-
-void split_set(interval_set&, int time);
-void undo_split_set(interval_set&, int time);
+void split_set(interval_set&, rti_time time);
+void undo_split_set(interval_set&, rti_time time);
 
 void create_interval_set(interval_set& i_set);
 void delete_interval_set(interval_set& i_set);
-static inline interval* get_interval_from_set(const interval_set& intervals, int time)
-{
-	const_interval_it it = intervals.lower_bound(time);
-	if(it == intervals.end()){ return (*intervals.rbegin()).second; }
-	//assert((*it).second->get_begin() <= time && (*it).second->get_end() >= time);
-	return (*it).second;
-};
 
 class interval{
 private:
-	int begin;        // inclusive
-	int end;          // inclusive
+	rti_time begin;   // inclusive
+	rti_time end;     // inclusive
 	tail_set tails;   // tails
 	timed_state* to;  // target state
 	
-	int num_marked;
+	rti_count size;   // number of timed strings in tails, counting duplicates
+	rti_count num_marked;
 
 	friend class timed_state;
 
-	friend void split_set(interval_set&, int time);
-	friend void undo_split_set(interval_set&, int time);
+	friend void split_set(interval_set&, rti_time time);
+	friend void undo_split_set(interval_set&, rti_time time);
 
-	friend interval_set& create_interval_set();
-	friend interval* get_interval(const interval_set&, int time);
+	friend void create_interval_set(interval_set& i_set);
 
 public:
 	double probability;
 	tail_set undo_tails;
 	timed_state* undo_to;
 
+	/* taken from and returned to a pool, see pool.h */
+	static inline void* operator new(size_t size){
+		assert(size == sizeof(interval));
+		return object_pool<interval>::allocate();
+	};
+	
+	static inline void operator delete(void* p){
+		object_pool<interval>::release(p);
+	};
+	
 	/* constructor */
-	interval(int b, int e);
+	interval(rti_time b, rti_time e);
 	
 	/* get methods */
 	inline timed_state* get_target() const{
@@ -87,11 +89,11 @@ public:
 		to = state;
 	};
 	
-	inline int get_begin() const{
+	inline rti_time get_begin() const{
 		return begin;
 	};
 	
-	inline int get_end() const{
+	inline rti_time get_end() const{
 		return end;
 	};
 	
@@ -99,15 +101,29 @@ public:
 		return tails;
 	};
 	
-	inline void add_tail(timed_tail* tail){
+	inline void add_tail(timed_tail tail){
 		add_tail_to_set(tails, tail);
+		size += tail.get_count();
 	};
 	
-	inline void del_tail(timed_tail* tail){
+	inline void del_tail(timed_tail tail){
 		del_tail_from_set(tails, tail);
+		size -= tail.get_count();
+	};
+	
+	/* adds all tails of in, does not remove them from in */
+	inline void add_tails(interval* in){
+		tails.insert(in->tails);
+		size += in->size;
+	};
+	
+	/* removes the tails that add_tails(in) added */
+	inline void del_tails(interval* in){
+		tails.erase(in->tails);
+		size -= in->size;
 	};
 	
-	inline bool contains_tail(timed_tail* tail){
+	inline bool contains_tail(timed_tail tail){
 		return contains_tail_in_set(tails, tail);
 	};
 
@@ -115,17 +131,148 @@ public:
 		return tails.empty();
 	};
 	
-	inline void add_marked(){
-		++num_marked;
+	inline rti_count get_size() const{
+		return size;
 	};
 	
-	inline void del_marked(){
-		--num_marked;
+	inline void add_marked(timed_tail tail){
+		num_marked += tail.get_count();
 	};
 	
-	inline int get_num_marked(){
+	inline void del_marked(timed_tail tail){
+		num_marked -= tail.get_count();
+	};
+	
+	inline rti_count get_num_marked(){
 		return num_marked;
 	};
 };
 
+typedef pair<rti_time, interval*> interval_entry;
+
+/* The intervals of the transitions of a state with one symbol, by their end times (inclusive).
+ * The last interval, ending at MAX_TIME, is never removed by a split and is stored inline,
+ * the intervals split off before it are kept in a sorted vector. A set that has not been split
+ * (almost all sets) allocates nothing. */
+class interval_set{
+	vector<interval_entry> lower;   // the intervals before the last one, by end time
+	interval last;
+	interval_entry last_entry;      // (MAX_TIME, &last)
+	
+	/* last_entry points into the set, so it cannot be copied */
+	interval_set(const interval_set&);
+	void operator=(const interval_set&);
+	
+	friend void split_set(interval_set&, rti_time time);
+	friend void undo_split_set(interval_set&, rti_time time);
+	friend void create_interval_set(interval_set& i_set);
+	friend void delete_interval_set(interval_set& i_set);
+	
+	/* the index of the interval that contains time, lower.size() for last */
+	inline unsigned int find_index(rti_time time) const{
+		unsigned int low = 0;
+		unsigned int high = lower.size();
+		while(low < high){
+			unsigned int middle = (low + high) / 2;
+			if(lower[middle].first < time) low = middle + 1;
+			else high = middle;
+		}
+		return low;
+	};
+	
+public:
+	class const_iterator{
+		const interval_set* set;
+		unsigned int index;
+		
+		friend class interval_set;
+		const_iterator(const interval_set* s, unsigned int i) : set(s), index(i) {};
+		
+	public:
+		typedef bidirectional_iterator_tag iterator_category;
+		typedef interval_entry value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const interval_entry* pointer;
+		typedef const interval_entry& reference;
+		
+		const_iterator() : set(0), index(0) {};
+		
+		inline const interval_entry& operator*() const{
+			return index < set->lower.size() ? set->lower[index] : set->last_entry;
+		};
+		
+		inline const interval_entry* operator->() const{
+			return &(**this);
+		};
+		
+		inline const_iterator& operator++(){
+			++index;
+			return *this;
+		};
+		
+		inline const_iterator& operator--(){
+			--index;
+			return *this;
+		};
+		
+		inline bool operator==(const const_iterator& other) const{
+			return index == other.index;
+		};
+		
+		inline bool operator!=(const const_iterator& other) const{
+			return index != other.index;
+		};
+	};
+	typedef const_iterator iterator;
+	typedef std::reverse_iterator<const_iterator> reverse_iterator;
+	
+	/* taken from and returned to a pool, see pool.h */
+	static inline void* operator new(size_t size){
+		assert(size == sizeof(interval_set));
+		return object_pool<interval_set>::allocate();
+	};
+	
+	static inline void operator delete(void* p){
+		object_pool<interval_set>::release(p);
+	};
+	
+	interval_set() : last(MIN_TIME, MAX_TIME), last_entry(MAX_TIME, &last) {};
+	~interval_set();
+	
+	inline const_iterator begin() const{
+		return const_iterator(this, 0);
+	};
+	
+	inline const_iterator end() const{
+		return const_iterator(this, lower.size() + 1);
+	};
+	
+	inline reverse_iterator rbegin() const{
+		return reverse_iterator(end());
+	};
+	
+	inline reverse_iterator rend() const{
+		return reverse_iterator(begin());
+	};
+	
+	inline unsigned int size() const{
+		return lower.size() + 1;
+	};
+	
+	/* the interval that contains time, the last one for times after MAX_TIME */
+	inline interval* get_interval(rti_time time) const{
+		unsigned int index = find_index(time);
+		return index == lower.size() ? last_entry.second : lower[index].second;
+	};
+};
+
+typedef interval_set::iterator interval_it;
+typedef interval_set::reverse_iterator interval_rit;
+typedef interval_set::const_iterator const_interval_it;
+
+static inline interval* get_interval_from_set(const interval_set& intervals, rti_time time)
+{
+	return intervals.get_interval(time);
+};
+
 #endif /* _INTERVAL_H_ */
@@ -0,0 +1,96 @@
+/*
+ *  RTI (real-time inference)
+ *  Parallel.cpp, the source file for the simple thread helpers used when loading data
+ *  
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#include "parallel.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+int NUM_THREADS = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+thread_local bool PARALLEL_WORKER = false;
+
+/* The threads of parallel_for and the job they work on. A thread joins a job while there are free slots,
+ * the caller closes the job when it runs out of tasks and waits until the threads that joined are done.
+ * The pool is never destroyed, its threads wait for a job until the program exits. */
+struct thread_pool{
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+	int num_threads;
+	long long job_number;
+	void (*job)(void*, int);
+	void* data;
+	int n;
+	atomic<int> next;
+	int free_slots;
+	int num_busy;
+	thread_pool() : num_threads(0), job_number(0), job(0), data(0), n(0), next(0), free_slots(0), num_busy(0) {};
+	
+	void work(){
+		PARALLEL_WORKER = true;
+		long long last_job = 0;
+		unique_lock<mutex> guard(lock);
+		while(true){
+			wake.wait(guard, [&](){ return job_number != last_job; });
+			last_job = job_number;
+			if(free_slots == 0) continue;
+			free_slots--;
+			num_busy++;
+			guard.unlock();
+			for(int i = next++; i < n; i = next++) job(data, i);
+			guard.lock();
+			if(--num_busy == 0) done.notify_one();
+		}
+	};
+};
+
+static thread_pool* POOL = new thread_pool();
+
+/* called by one thread at a time, tasks that call parallel_for run it on their own thread (PARALLEL_WORKER) */
+void run_parallel(int n, int num_threads, void (*job)(void*, int), void* data){
+	thread_pool& pool = *POOL;
+	{
+		lock_guard<mutex> guard(pool.lock);
+		for(; pool.num_threads < num_threads - 1; ++pool.num_threads)
+			thread(&thread_pool::work, &pool).detach();
+		pool.job = job;
+		pool.data = data;
+		pool.n = n;
+		pool.next = 0;
+		pool.free_slots = num_threads - 1;
+		pool.job_number++;
+	}
+	pool.wake.notify_all();
+	
+	PARALLEL_WORKER = true;
+	for(int i = pool.next++; i < n; i = pool.next++) job(data, i);
+	PARALLEL_WORKER = false;
+	
+	unique_lock<mutex> guard(pool.lock);
+	pool.free_slots = 0;
+	pool.done.wait(guard, [&](){ return pool.num_busy == 0; });
+};
+
+void split_lines(const char* begin, const char* end, int num_chunks, vector<const char*>& bounds){
+	bounds.assign(1, begin);
+	for(int i = 0; i < num_chunks; ++i){
+		const char* chunk_end = end;
+		if(i + 1 < num_chunks){
+			chunk_end = begin + ((end - begin) * (long long)(i + 1)) / num_chunks;
+			if(chunk_end < bounds.back()) chunk_end = bounds.back();
+			while(chunk_end != end && *chunk_end != '\n') ++chunk_end;
+		}
+		bounds.push_back(chunk_end);
+	}
+};
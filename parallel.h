@@ -0,0 +1,53 @@
+/*
+ *  RTI (real-time inference)
+ *  Parallel.h, the header file for the simple thread helpers used when loading data and searching
+ *
+ *  NUM_THREADS is the number of worker threads used, it defaults to the number of cores
+ *  and can be set using the -t option of rti. The threads of parallel_for are started by the
+ *  first call that needs them and wait for the next call afterwards, so their thread_local
+ *  data (work stacks, free lists of the pools) is kept between the calls.
+ *  
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <vector>
+
+using namespace std;
+
+extern int NUM_THREADS;
+
+/* set in the threads of parallel_for, a parallel_for inside a task runs on the thread of that task */
+extern thread_local bool PARALLEL_WORKER;
+
+/* calls job(data, i) for every i in [0, n) on the calling thread and num_threads - 1 threads of the pool */
+void run_parallel(int n, int num_threads, void (*job)(void*, int), void* data);
+
+template <class T> void call_task(void* task, int i){
+	(*(T*)task)(i);
+};
+
+/* calls task(i) for every i in [0, n), using at most NUM_THREADS threads
+ * the tasks are handed out in order, task(i) should not depend on task(j) */
+template <class T> void parallel_for(int n, T& task){
+	int num_threads = NUM_THREADS < n ? NUM_THREADS : n;
+	if(num_threads <= 1 || PARALLEL_WORKER){
+		for(int i = 0; i < n; ++i) task(i);
+		return;
+	}
+	run_parallel(n, num_threads, call_task<T>, &task);
+};
+
+/* splits [begin, end) into num_chunks parts that end at line ends (some may be empty),
+ * part i is [bounds[i], bounds[i + 1]) */
+void split_lines(const char* begin, const char* end, int num_chunks, vector<const char*>& bounds);
+
+#endif /* _PARALLEL_H_ */
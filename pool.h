@@ -0,0 +1,156 @@
+/*
+ *  RTI (real-time inference)
+ *  Pool.h, the header file for the object pools of the states, intervals and state statistics
+ *
+ *  The search creates and deletes these objects at every refinement and its undo. Their classes take
+ *  their memory from an object_pool: objects are cut from slabs of POOL_SLAB_SIZE objects and put on a
+ *  free list when deleted, the next object of the same type reuses them. Every thread has its own free list,
+ *  so no lock is taken unless the list is empty, the free list of a thread that ends is handed to the pool.
+ *  The slabs are only returned to the system at exit. The objects in use are also counted per thread, the
+ *  occupancy is only exact when no other thread is allocating.
+ *
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+using namespace std;
+
+/* the number of objects in a slab */
+const int POOL_SLAB_SIZE = 256;
+
+template <class T> class object_pool{
+	union slot{
+		slot* next;
+		alignas(T) char data[sizeof(T)];
+	};
+
+	struct free_list;
+
+	/* the free slots of ended threads, the slabs and the free lists of the running threads */
+	struct shared_pool{
+		mutex lock;
+		slot* head;
+		vector<slot*> slabs;
+		vector<free_list*> lists;
+		long long num_used;       // by ended threads
+		long long num_allocated;
+		shared_pool() : head(0), num_used(0), num_allocated(0) {};
+		~shared_pool(){
+			for(unsigned int i = 0; i < slabs.size(); ++i) delete[] slabs[i];
+		};
+	};
+
+	/* the free list of a thread, num_used is negative when it deleted objects of other threads,
+	 * only the thread changes it (without a locked instruction), it is atomic so other threads can read it */
+	struct free_list{
+		slot* head;
+		atomic<long long> num_used;
+		free_list() : head(0), num_used(0){
+			shared_pool& pool = shared();
+			lock_guard<mutex> guard(pool.lock);
+			pool.lists.push_back(this);
+		};
+		~free_list(){
+			give_back(head);
+			shared_pool& pool = shared();
+			lock_guard<mutex> guard(pool.lock);
+			pool.num_used += num_used.load(memory_order_relaxed);
+			for(unsigned int i = 0; i < pool.lists.size(); ++i){
+				if(pool.lists[i] == this){
+					pool.lists.erase(pool.lists.begin() + i);
+					break;
+				}
+			}
+		};
+	};
+
+	static inline shared_pool& shared(){
+		static shared_pool pool;
+		return pool;
+	};
+
+	static inline free_list& local(){
+		static thread_local free_list list;
+		return list;
+	};
+
+	/* takes at most a slab of the shared free slots, so the other threads find some too, or a new slab when there are none */
+	static void refill(free_list& list){
+		shared_pool& pool = shared();
+		lock_guard<mutex> guard(pool.lock);
+		if(pool.head != 0){
+			slot* last = pool.head;
+			for(int i = 1; i < POOL_SLAB_SIZE && last->next != 0; ++i) last = last->next;
+			list.head = pool.head;
+			pool.head = last->next;
+			last->next = 0;
+			return;
+		}
+		slot* slab = new slot[POOL_SLAB_SIZE];
+		for(int i = 0; i < POOL_SLAB_SIZE - 1; ++i) slab[i].next = &slab[i + 1];
+		slab[POOL_SLAB_SIZE - 1].next = 0;
+		pool.slabs.push_back(slab);
+		pool.num_allocated += POOL_SLAB_SIZE;
+		list.head = slab;
+	};
+
+	static void give_back(slot* head){
+		if(head == 0) return;
+		slot* tail = head;
+		while(tail->next != 0) tail = tail->next;
+		shared_pool& pool = shared();
+		lock_guard<mutex> guard(pool.lock);
+		tail->next = pool.head;
+		pool.head = head;
+	};
+
+public:
+	static inline void* allocate(){
+		free_list& list = local();
+		if(list.head == 0) refill(list);
+		slot* s = list.head;
+		list.head = s->next;
+		list.num_used.store(list.num_used.load(memory_order_relaxed) + 1, memory_order_relaxed);
+		return s;
+	};
+
+	static inline void release(void* p){
+		if(p == 0) return;
+		free_list& list = local();
+		slot* s = (slot*)p;
+		s->next = list.head;
+		list.head = s;
+		list.num_used.store(list.num_used.load(memory_order_relaxed) - 1, memory_order_relaxed);
+	};
+
+	/* the number of objects in use */
+	static long long get_num_used(){
+		shared_pool& pool = shared();
+		lock_guard<mutex> guard(pool.lock);
+		long long result = pool.num_used;
+		for(unsigned int i = 0; i < pool.lists.size(); ++i) result += pool.lists[i]->num_used.load(memory_order_relaxed);
+		return result;
+	};
+
+	/* the number of objects in the slabs, used or free */
+	static long long get_num_allocated(){
+		shared_pool& pool = shared();
+		lock_guard<mutex> guard(pool.lock);
+		return pool.num_allocated;
+	};
+};
+
+#endif /* _POOL_H_ */
@@ -34,6 +34,8 @@
 #include <stdio.h>
 #include <queue>
 #include "searcher.h"
+#include "parallel.h"
+#include "event_log.h"
 
 
 using namespace std;
@@ -68,16 +70,16 @@ double calculate_aic(){
 				result += log_prob * (double)st->stat->get_symbol_counts(s);
 				num_tests += ((double)st->stat->get_symbol_counts(s)) / 2.0;
 			}
-			for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
+			for(const_interval_it it2 = st->find_intervals(s).begin(); it2 != st->find_intervals(s).end(); ++it2){
 				interval* inter = (*it2).second;
 				if(TA->contains_state(inter->get_target()) || inter->is_empty()) continue;
 			 
 				for(const_tail_it it3 = inter->get_tails().begin(); it3 != inter->get_tails().end(); ++it3){
-					timed_tail* tail = (*it3).second;
+					timed_tail tail = (*it3).second;
 			 
-					if(tail->next_tail() != 0){
-						result += default_log * (tail->get_length() - 1);
-						num_tests += (double)(tail->get_length() - 1);
+					if(tail.has_next_tail()){
+						result += default_log * (tail.get_length() - 1) * tail.get_count();
+						num_tests += (double)(tail.get_length() - 1) * tail.get_count();
 					}
 				}
 			 }
@@ -120,7 +122,22 @@ double calculate_aic_without_default(){
 	return (2.0 * ((double)calculate_parameters())) - (2.0 * result);
 }
 
-refinement::refinement(int s, int t, int sy, int ti){
+/* tests the merge of an interval of state into every state of the automaton but the root, a task per state,
+ * the tests only read the automaton so they can run at the same time */
+struct merge_task{
+	int state;
+	int symbol;
+	rti_time time;
+	vector<double>& scores;
+	merge_task(int st, int sy, rti_time t, vector<double>& s) : state(st), symbol(sy), time(t), scores(s) {};
+
+	void operator()(int i){
+		timed_state* target = TA->get_state(i);
+		if(target != TA->get_root()) scores[i] = TA->get_state(state)->test_point(symbol, time, target);
+	};
+};
+
+refinement::refinement(int s, int t, int sy, rti_time ti){
 	state = s;
 	target = t;
 	symbol = sy;
@@ -143,46 +160,48 @@ pair<refinement_set*,refinement_set*> get_best_refinements(){
 	int state = 0;
 	//int num_intervals = -1;
 	int symbol = -1;
-	int max_size = -1;
+	rti_count max_size = -1;
 	
 	for(int i = 0; i < TA->num_states(); ++i){
 		timed_state* st = TA->get_state(i);
-		for(int s = 0; s < MAX_SYMBOL; ++s){
+		for(int s = st->first_symbol(); s < MAX_SYMBOL; s = st->next_symbol(s)){
 			for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
 				interval* inter = (*it2).second;
 				if(TA->contains_state(inter->get_target()) || inter->is_empty()) continue;
 
-				if(max_size == -1 || inter->get_tails().size() > max_size){
+				if(max_size == -1 || inter->get_size() > max_size){
 					in = inter;
 					//num_intervals = st->get_intervals(s).size();
 					state = i;
 					symbol = s;
-					max_size = in->get_tails().size();
+					max_size = in->get_size();
 				}
 			}
 		}
 	}
 	
 	if(in == 0) return result;
-	if(in->get_tails().size() < 2 * MIN_DATA) return result;
+	if(in->get_size() < 2 * MIN_DATA) return result;
 
 	TA->check_consistency();
 	
+	/* the scores are added in the order of the states, as when they are tested one by one */
+	vector<double> scores(TA->num_states(), -1.0);
+	merge_task task(state, symbol, in->get_end(), scores);
+	/* with fewer states than threads, the states are tested one by one and a large test uses the threads itself */
+	if(TA->num_states() >= NUM_THREADS) parallel_for(TA->num_states(), task);
+	else for(int i = 0; i < TA->num_states(); ++i) task(i);
 	for(int i = 0; i < TA->num_states(); ++i){
-		timed_state* target = TA->get_state(i);
-		if(target != TA->get_root()){
-			double score = TA->get_state(state)->test_point(symbol, in->get_end(), target);
-			if(score != -1.0) merges->insert(pair<double, refinement>(score, refinement(state, i, symbol, in->get_end())));
-		}
+		if(scores[i] != -1.0) merges->insert(pair<double, refinement>(scores[i], refinement(state, i, symbol, in->get_end())));
 	}
 	TA->check_consistency();
 
 	merges->insert(pair<double, refinement>(SIGNIFICANCE, refinement(state, -2, symbol, in->get_end())));
 	
-	int time = (*in->get_tails().begin()).first;
+	rti_time time = (*in->get_tails().begin()).first;
 	for(const_tail_it it3 = in->get_tails().begin(); it3 != in->get_tails().end(); ++it3){
-		timed_tail* tail = (*it3).second;
-		if(time < tail->get_time_value()){
+		timed_tail tail = (*it3).second;
+		if(time < tail.get_time_value()){
 			double score = TA->get_state(state)->test_split(symbol, time);
 			if(score != -1.0) splits->insert(pair<double, refinement>(score, refinement(state, -1, symbol, time)));
 			time = (*it3).first;
@@ -385,26 +404,74 @@ void test(){
 }
 
 int main(int argc, const char *argv[]){
-	if(argc != 4){
-		cerr << "Usage: ./rti TEST_TYPE SIGNIFICANCE file" << endl;
+	int arg = 1;
+	bool event_input = false;
+	bool verbose = false;
+	long long gap_timeout = 0;
+	while(arg + 1 < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'){
+		if(string(argv[arg]) == "-l"){
+			LAZY_TREE = true;
+			arg += 1;
+			continue;
+		}
+		if(string(argv[arg]) == "-m"){
+			SHARDED_TREE = true;
+			arg += 1;
+			continue;
+		}
+		if(string(argv[arg]) == "-v"){
+			verbose = true;
+			arg += 1;
+			continue;
+		}
+		if(string(argv[arg]) == "-t") NUM_THREADS = atoi(argv[arg + 1]);
+		else if(string(argv[arg]) == "-s"){
+			event_input = true;
+			gap_timeout = atoll(argv[arg + 1]);
+		}
+		else break;
+		arg += 2;
+	}
+	if(NUM_THREADS < 1) NUM_THREADS = 1;
+	
+	if(argc - arg < 3){
+		cerr << "Usage: ./rti [-t threads] [-s gap_timeout] [-l] [-m] [-v] TEST_TYPE SIGNIFICANCE file..." << endl;
+		cerr << "  threads is the number of threads used, default is the number of cores" << endl;
+		cerr << "  -s reads file as an event log (entity,timestamp,event per line) and splits the events" << endl;
+		cerr << "     of every entity into sessions at gaps larger than gap_timeout (0 for one session per entity)" << endl;
+		cerr << "  -l builds the prefix tree lazily, only the parts that are tested are built" << endl;
+		cerr << "  -m builds the prefix trees of ranges of the strings on their own threads and merges them" << endl;
+		cerr << "  -v prints the use of the object pools at the end" << endl;
 		cerr << "  TEST_TYPE is 1 for likelihood ratio, 2 for chi squared" << endl;
 		cerr << "  SIGNIFICANCE is a decision (float) value between 0.0 and 1.0, default is 0.05 (5% significance)" << endl;
-		cerr << "  file is an input file conaining unlabeled timed strings" << endl;
+		cerr << "  file is an input file conaining unlabeled timed strings, several (text) files are read as one input" << endl;
 		return 0;
 	}
 	
-	ifstream test_file(argv[3]);
-	if(!test_file.is_open())
-		return 0;
+	vector<const char*> file_names(argv + arg + 2, argv + argc);
+	for(unsigned int i = 0; i < file_names.size(); ++i){
+		ifstream test_file(file_names[i]);
+		if(!test_file.is_open())
+			return 0;
+		test_file.close();
+	}
 	
-	timed_input *in = new timed_input(test_file);
-	test_file.close();
+	timed_input *in;
+	if(event_input){
+		event_log log(file_names, gap_timeout);
+		in = log.get_input();
+	} else if(file_names.size() == 1){
+		in = new timed_input(file_names[0]);
+	} else {
+		in = new timed_input(file_names);
+	}
 	
-	TEST_TYPE = atoi(argv[1]);
-	SIGNIFICANCE = atof(argv[2]);
+	TEST_TYPE = atoi(argv[arg]);
+	SIGNIFICANCE = atof(argv[arg + 1]);
 	
 	TA = new timed_automaton(in);	
 	bestfirst();
+	if(verbose) cerr << pool_usage();
 	
 	return 1;
 }
@@ -48,12 +48,12 @@ class refinement{
 	int state;
 	int target;
 	int symbol;
-	int time;
+	rti_time time;
 	
 public:
 	int ref_count;
 	
-	refinement(int s, int t, int sy, int ti);
+	refinement(int s, int t, int sy, rti_time ti);
 
 	inline void print() const{
 		if(target > -1)
@@ -26,6 +26,8 @@
  */
 
 #include <math.h>
+#include <vector>
+#include <mutex>
 #include <gsl/gsl_cdf.h>
 #include "statistics.h"
 
@@ -63,9 +65,20 @@ double calculate_chi2_value(double first, double second, double total1, double t
 	return ((top1*top1)/expected1) + ((top2*top2)/expected2);
 };
 
-/* The Fisher's method consensus test */
-double sum_z_values = 0.0;
-double num_tests = 0.0;
+/* When set, the terms of the tests of this thread are stored in it instead of added, a part of a test that runs
+ * on another thread keeps its terms and add_test_terms adds them to the test in the order of a test on one thread */
+thread_local vector< pair<double, int> >* TEST_TERMS = 0;
+
+void add_test_terms(const vector< pair<double, int> >& terms, unsigned int begin, unsigned int end){
+	for(unsigned int i = begin; i < end; ++i){
+		if(TEST_TYPE == 2) add_to_consensus_test(terms[i].first);
+		else add_to_likelihood_test(terms[i].first, terms[i].second);
+	}
+};
+
+/* The Fisher's method consensus test, the sums are kept per thread so tests can run on several threads */
+thread_local double sum_z_values = 0.0;
+thread_local double num_tests = 0.0;
 
 void initialize_consensus_test(){
 	sum_z_values = 0.0;
@@ -73,6 +86,10 @@ void initialize_consensus_test(){
 };
 
 void add_to_consensus_test(double p_value){
+	if(TEST_TERMS != 0){
+		TEST_TERMS->push_back(pair<double, int>(p_value, 0));
+		return;
+	}
 	if(p_value == 1.0) p_value = MAX_P_VALUE;
 	sum_z_values += - 2.0 * log(p_value);
 	num_tests++;
@@ -84,9 +101,9 @@ double calculate_consensus_test(){
 };
 /* End of Fisher's method consensus test */
 
-/* The likelihood ratio test */
-double ml_ratio = 0.0;
-int ml_parameters = 0;
+/* The likelihood ratio test, also per thread */
+thread_local double ml_ratio = 0.0;
+thread_local int ml_parameters = 0;
 
 void initialize_likelihood_test(){
 	ml_ratio = 0.0;
@@ -94,6 +111,10 @@ void initialize_likelihood_test(){
 };
 
 void add_to_likelihood_test(double ratio, int parameters){
+	if(TEST_TERMS != 0){
+		TEST_TERMS->push_back(pair<double, int>(ratio, parameters));
+		return;
+	}
 	ml_ratio += ratio;
 	ml_parameters += parameters;
 };
@@ -108,21 +129,21 @@ double calculate_likelihood_test(){
 
 /* Calculates the chi^2 value of the SYMBOL distributions
  * for merging two states and adds the result to the consensus test */ 
-double calculate_chi2_score(timed_state* old_target, timed_state* new_target){
-	if(old_target == 0 || new_target == 0) return -1.0;
+double calculate_chi2_score(state_statistics* old_stat, state_statistics* new_stat){
+	if(old_stat == 0 || new_stat == 0) return -1.0;
 	
 	/* total counts */
-	int total_old = old_target->stat->get_total_counts();
-	int total_new = new_target->stat->get_total_counts();
+	rti_count total_old = old_stat->get_total_counts();
+	rti_count total_new = new_stat->get_total_counts();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return -1.0;
 
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(old_target->stat->symbol_counts[i] < MIN_DATA && new_target->stat->symbol_counts[i] < MIN_DATA){
-			old_pool += old_target->stat->symbol_counts[i];
-			new_pool += new_target->stat->symbol_counts[i];
+		if(old_stat->symbol_counts(i) < MIN_DATA && new_stat->symbol_counts(i) < MIN_DATA){
+			old_pool += old_stat->symbol_counts(i);
+			new_pool += new_stat->symbol_counts(i);
 		}
 	}
 	
@@ -138,9 +159,9 @@ double calculate_chi2_score(timed_state* old_target, timed_state* new_target){
 	double chi2_dof = -1.0;
 	
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(old_target->stat->symbol_counts[i] < MIN_DATA && new_target->stat->symbol_counts[i] < MIN_DATA) continue;
+		if(old_stat->symbol_counts(i) < MIN_DATA && new_stat->symbol_counts(i) < MIN_DATA) continue;
 			
-		chi2_value += calculate_chi2_value(old_target->stat->symbol_counts[i], new_target->stat->symbol_counts[i], total_old, total_new);
+		chi2_value += calculate_chi2_value(old_stat->symbol_counts(i), new_stat->symbol_counts(i), total_old, total_new);
 		chi2_dof += 1.0;
 	}
 	
@@ -166,17 +187,17 @@ double calculate_chi2_score(timed_state* target){
 	if(target == 0) return -1.0;
 	
 	/* total counts */
-	int total_old = target->stat->get_total_counts();
-	int total_new = target->stat->get_total_marks();
+	rti_count total_old = target->stat->get_total_counts();
+	rti_count total_new = target->stat->get_total_marks();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return -1.0;
 
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(target->stat->symbol_counts[i] < MIN_DATA && target->stat->symbol_marks[i] < MIN_DATA){
-			old_pool += target->stat->symbol_counts[i];
-			new_pool += target->stat->symbol_marks[i];
+		if(target->stat->symbol_counts(i) < MIN_DATA && target->stat->symbol_marks(i) < MIN_DATA){
+			old_pool += target->stat->symbol_counts(i);
+			new_pool += target->stat->symbol_marks(i);
 		}
 	}
 	
@@ -192,9 +213,9 @@ double calculate_chi2_score(timed_state* target){
 	double chi2_dof = -1.0;
 	
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(target->stat->symbol_counts[i] < MIN_DATA && target->stat->symbol_marks[i] < MIN_DATA) continue;
+		if(target->stat->symbol_counts(i) < MIN_DATA && target->stat->symbol_marks(i) < MIN_DATA) continue;
 		
-		chi2_value += calculate_chi2_value(target->stat->symbol_counts[i], target->stat->symbol_marks[i], total_old, total_new);
+		chi2_value += calculate_chi2_value(target->stat->symbol_counts(i), target->stat->symbol_marks(i), total_old, total_new);
 		chi2_dof += 1.0;
 	}
 	
@@ -216,21 +237,21 @@ double calculate_chi2_score(timed_state* target){
 
 /* Calculates the chi^2 value of the TIME distributions
  * for merging two states and adds the result to the consensus test */ 
-double calculate_chi2_score_time(timed_state* old_target, timed_state* new_target){
-	if(old_target == 0 || new_target == 0) return -1.0;
+double calculate_chi2_score_time(state_statistics* old_stat, state_statistics* new_stat){
+	if(old_stat == 0 || new_stat == 0) return -1.0;
 	
 	/* total counts */
-	int total_old = old_target->stat->get_total_counts();
-	int total_new = new_target->stat->get_total_counts();
+	rti_count total_old = old_stat->get_total_counts();
+	rti_count total_new = new_stat->get_total_counts();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return -1.0;
 
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(old_target->stat->time_counts[i] < MIN_DATA && new_target->stat->time_counts[i] < MIN_DATA){
-			old_pool += old_target->stat->time_counts[i];
-			new_pool += new_target->stat->time_counts[i];
+		if(old_stat->time_counts(i) < MIN_DATA && new_stat->time_counts(i) < MIN_DATA){
+			old_pool += old_stat->time_counts(i);
+			new_pool += new_stat->time_counts(i);
 		}
 	}
 	
@@ -246,9 +267,9 @@ double calculate_chi2_score_time(timed_state* old_target, timed_state* new_targe
 	double chi2_dof = -1.0;
 	
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(old_target->stat->time_counts[i] < MIN_DATA && new_target->stat->time_counts[i] < MIN_DATA) continue;
+		if(old_stat->time_counts(i) < MIN_DATA && new_stat->time_counts(i) < MIN_DATA) continue;
 			
-		chi2_value += calculate_chi2_value(old_target->stat->time_counts[i], new_target->stat->time_counts[i], total_old, total_new);
+		chi2_value += calculate_chi2_value(old_stat->time_counts(i), new_stat->time_counts(i), total_old, total_new);
 		chi2_dof += 1.0;
 	}
 	
@@ -274,17 +295,17 @@ double calculate_chi2_score_time(timed_state* target){
 	if(target == 0) return -1.0;
 	
 	/* total counts */
-	int total_old = target->stat->get_total_counts();
-	int total_new = target->stat->get_total_marks();
+	rti_count total_old = target->stat->get_total_counts();
+	rti_count total_new = target->stat->get_total_marks();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return -1.0;
 
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(target->stat->time_counts[i] < MIN_DATA && target->stat->time_marks[i] < MIN_DATA){
-			old_pool += target->stat->time_counts[i];
-			new_pool += target->stat->time_marks[i];
+		if(target->stat->time_counts(i) < MIN_DATA && target->stat->time_marks(i) < MIN_DATA){
+			old_pool += target->stat->time_counts(i);
+			new_pool += target->stat->time_marks(i);
 		}
 	}
 	
@@ -300,9 +321,9 @@ double calculate_chi2_score_time(timed_state* target){
 	double chi2_dof = -1.0;
 	
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(target->stat->time_counts[i] < MIN_DATA && target->stat->time_marks[i] < MIN_DATA) continue;
+		if(target->stat->time_counts(i) < MIN_DATA && target->stat->time_marks(i) < MIN_DATA) continue;
 		
-		chi2_value += calculate_chi2_value(target->stat->time_counts[i], target->stat->time_marks[i], total_old, total_new);
+		chi2_value += calculate_chi2_value(target->stat->time_counts(i), target->stat->time_marks(i), total_old, total_new);
 		chi2_dof += 1.0;
 	}
 	
@@ -324,22 +345,22 @@ double calculate_chi2_score_time(timed_state* target){
 
 /* Calculates the likelihood ratio of the SYMBOL distributions
  * for merging two states and adds the result to the likelihood ratio test */ 
-pair<int, double> get_likelihood_ratio(timed_state* old_target, timed_state* new_target){
+pair<int, double> get_likelihood_ratio(state_statistics* old_stat, state_statistics* new_stat){
 	int extra_parameters = 0;
 	double ratio = 0.0;
 	
 	/* total counts */
-	int total_old = old_target->stat->get_total_counts();
-	int total_new = new_target->stat->get_total_counts();
+	rti_count total_old = old_stat->get_total_counts();
+	rti_count total_new = new_stat->get_total_counts();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return pair<int, double>(0, 0.0);
 	
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(old_target->stat->symbol_counts[i] < MIN_DATA && new_target->stat->symbol_counts[i] < MIN_DATA){
-			old_pool += old_target->stat->symbol_counts[i];
-			new_pool += new_target->stat->symbol_counts[i];
+		if(old_stat->symbol_counts(i) < MIN_DATA && new_stat->symbol_counts(i) < MIN_DATA){
+			old_pool += old_stat->symbol_counts(i);
+			new_pool += new_stat->symbol_counts(i);
 		}
 	}
 	
@@ -352,21 +373,21 @@ pair<int, double> get_likelihood_ratio(timed_state* old_target, timed_state* new
 	
 	/* calculating ratio and parameters */
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(old_target->stat->symbol_counts[i] < MIN_DATA && new_target->stat->symbol_counts[i] < MIN_DATA) continue;
+		if(old_stat->symbol_counts(i) < MIN_DATA && new_stat->symbol_counts(i) < MIN_DATA) continue;
 		
-		double top_probability = ((double)(old_target->stat->symbol_counts[i] + new_target->stat->symbol_counts[i]))
+		double top_probability = ((double)(old_stat->symbol_counts(i) + new_stat->symbol_counts(i)))
 		/ ((double)(total_old + total_new));
 		
 		double bottom_probability1 = 1.0;
-		if(old_target->stat->symbol_counts[i] != 0) bottom_probability1 = ((double)old_target->stat->symbol_counts[i]) / ((double)total_old);
+		if(old_stat->symbol_counts(i) != 0) bottom_probability1 = ((double)old_stat->symbol_counts(i)) / ((double)total_old);
 		
 		double bottom_probability2 = 1.0;
-		if(new_target->stat->symbol_counts[i] != 0) bottom_probability2 = ((double)new_target->stat->symbol_counts[i]) / ((double)total_new);
+		if(new_stat->symbol_counts(i) != 0) bottom_probability2 = ((double)new_stat->symbol_counts(i)) / ((double)total_new);
 		
-		ratio += (double)old_target->stat->symbol_counts[i] * log(top_probability);
-		ratio -= (double)old_target->stat->symbol_counts[i] * log(bottom_probability1);
-		ratio += (double)new_target->stat->symbol_counts[i] * log(top_probability);
-		ratio -= (double)new_target->stat->symbol_counts[i] * log(bottom_probability2);
+		ratio += (double)old_stat->symbol_counts(i) * log(top_probability);
+		ratio -= (double)old_stat->symbol_counts(i) * log(bottom_probability1);
+		ratio += (double)new_stat->symbol_counts(i) * log(top_probability);
+		ratio -= (double)new_stat->symbol_counts(i) * log(bottom_probability2);
 		extra_parameters++;
 	}
 	
@@ -392,22 +413,22 @@ pair<int, double> get_likelihood_ratio(timed_state* old_target, timed_state* new
 
 /* Calculates the likelihood ratio of the TIME distributions
  * for merging two states and adds the result to the likelihood ratio test */ 
-pair<int, double> get_likelihood_ratio_time(timed_state* old_target, timed_state* new_target){
+pair<int, double> get_likelihood_ratio_time(state_statistics* old_stat, state_statistics* new_stat){
 	int extra_parameters = 0;
 	double ratio = 0.0;
 	
 	/* total counts */
-	int total_old = old_target->stat->get_total_counts();
-	int total_new = new_target->stat->get_total_counts();
+	rti_count total_old = old_stat->get_total_counts();
+	rti_count total_new = new_stat->get_total_counts();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return pair<int, double>(0, 0.0);
 
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	/* pooling less than MIN_DATA counts */
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(old_target->stat->time_counts[i] < MIN_DATA && new_target->stat->time_counts[i] < MIN_DATA){
-			old_pool += old_target->stat->time_counts[i];
-			new_pool += new_target->stat->time_counts[i];
+		if(old_stat->time_counts(i) < MIN_DATA && new_stat->time_counts(i) < MIN_DATA){
+			old_pool += old_stat->time_counts(i);
+			new_pool += new_stat->time_counts(i);
 		}
 	}
 	
@@ -420,21 +441,21 @@ pair<int, double> get_likelihood_ratio_time(timed_state* old_target, timed_state
 	
 	/* calculating ratio and parameters */
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(old_target->stat->time_counts[i] < MIN_DATA && new_target->stat->time_counts[i] < MIN_DATA) continue;
+		if(old_stat->time_counts(i) < MIN_DATA && new_stat->time_counts(i) < MIN_DATA) continue;
 		
-		double top_probability = ((double)(old_target->stat->time_counts[i] + new_target->stat->time_counts[i]))
+		double top_probability = ((double)(old_stat->time_counts(i) + new_stat->time_counts(i)))
 		/ ((double)(total_old + total_new));
 		
 		double bottom_probability1 = 1.0;
-		if(old_target->stat->time_counts[i] != 0) bottom_probability1 = ((double)old_target->stat->time_counts[i]) / ((double)total_old);
+		if(old_stat->time_counts(i) != 0) bottom_probability1 = ((double)old_stat->time_counts(i)) / ((double)total_old);
 		
 		double bottom_probability2 = 1.0;
-		if(new_target->stat->time_counts[i] != 0) bottom_probability2 = ((double)new_target->stat->time_counts[i]) / ((double)total_new);
+		if(new_stat->time_counts(i) != 0) bottom_probability2 = ((double)new_stat->time_counts(i)) / ((double)total_new);
 		
-		ratio += (double)old_target->stat->time_counts[i] * log(top_probability);
-		ratio -= (double)old_target->stat->time_counts[i] * log(bottom_probability1);
-		ratio += (double)new_target->stat->time_counts[i] * log(top_probability);
-		ratio -= (double)new_target->stat->time_counts[i] * log(bottom_probability2);
+		ratio += (double)old_stat->time_counts(i) * log(top_probability);
+		ratio -= (double)old_stat->time_counts(i) * log(bottom_probability1);
+		ratio += (double)new_stat->time_counts(i) * log(top_probability);
+		ratio -= (double)new_stat->time_counts(i) * log(bottom_probability2);
 		extra_parameters++;
 	}
 	
@@ -465,17 +486,17 @@ pair<int, double> get_likelihood_ratio(timed_state* target){
 	double ratio = 0.0;
 	
 	/* total counts */
-	int total_old = target->stat->get_total_counts();
-	int total_new = target->stat->get_total_marks();
+	rti_count total_old = target->stat->get_total_counts();
+	rti_count total_new = target->stat->get_total_marks();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return pair<int, double>(0, 0.0);;
 	
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(target->stat->symbol_counts[i] < MIN_DATA && target->stat->symbol_marks[i] < MIN_DATA){
-			old_pool += target->stat->symbol_counts[i];
-			new_pool += target->stat->symbol_marks[i];
+		if(target->stat->symbol_counts(i) < MIN_DATA && target->stat->symbol_marks(i) < MIN_DATA){
+			old_pool += target->stat->symbol_counts(i);
+			new_pool += target->stat->symbol_marks(i);
 		}
 	}
 	
@@ -488,21 +509,21 @@ pair<int, double> get_likelihood_ratio(timed_state* target){
 	
 	/* calculating ratio and parameters */
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if(target->stat->symbol_counts[i] < MIN_DATA && target->stat->symbol_marks[i] < MIN_DATA) continue;
+		if(target->stat->symbol_counts(i) < MIN_DATA && target->stat->symbol_marks(i) < MIN_DATA) continue;
 		
-		double top_probability = ((double)(target->stat->symbol_counts[i] + target->stat->symbol_marks[i]))
+		double top_probability = ((double)(target->stat->symbol_counts(i) + target->stat->symbol_marks(i)))
 		/ ((double)(total_old + total_new));
 		
 		double bottom_probability1 = 1.0;
-		if(target->stat->symbol_counts[i] != 0) bottom_probability1 = ((double)target->stat->symbol_counts[i]) / ((double)total_old);
+		if(target->stat->symbol_counts(i) != 0) bottom_probability1 = ((double)target->stat->symbol_counts(i)) / ((double)total_old);
 		
 		double bottom_probability2 = 1.0;
-		if(target->stat->symbol_marks[i] != 0) bottom_probability2 = ((double)target->stat->symbol_marks[i]) / ((double)total_new);
+		if(target->stat->symbol_marks(i) != 0) bottom_probability2 = ((double)target->stat->symbol_marks(i)) / ((double)total_new);
 		
-		ratio += (double)target->stat->symbol_counts[i] * log(top_probability);
-		ratio -= (double)target->stat->symbol_counts[i] * log(bottom_probability1);
-		ratio += (double)target->stat->symbol_marks[i] * log(top_probability);
-		ratio -= (double)target->stat->symbol_marks[i] * log(bottom_probability2);
+		ratio += (double)target->stat->symbol_counts(i) * log(top_probability);
+		ratio -= (double)target->stat->symbol_counts(i) * log(bottom_probability1);
+		ratio += (double)target->stat->symbol_marks(i) * log(top_probability);
+		ratio -= (double)target->stat->symbol_marks(i) * log(bottom_probability2);
 		extra_parameters++;
 	}
 	
@@ -533,17 +554,17 @@ pair<int, double> get_likelihood_ratio_time(timed_state* target){
 	double ratio = 0.0;
 	
 	/* total counts */
-	int total_old = target->stat->get_total_counts();
-	int total_new = target->stat->get_total_marks();
+	rti_count total_old = target->stat->get_total_counts();
+	rti_count total_new = target->stat->get_total_marks();
 	if(total_old < MIN_DATA || total_new < MIN_DATA) return pair<int, double>(0, 0.0);;
 	
 	/* pooling less than MIN_DATA counts */
-	int old_pool = 0;
-	int new_pool = 0;
+	rti_count old_pool = 0;
+	rti_count new_pool = 0;
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(target->stat->time_counts[i] < MIN_DATA && target->stat->time_marks[i] < MIN_DATA){
-			old_pool += target->stat->time_counts[i];
-			new_pool += target->stat->time_marks[i];
+		if(target->stat->time_counts(i) < MIN_DATA && target->stat->time_marks(i) < MIN_DATA){
+			old_pool += target->stat->time_counts(i);
+			new_pool += target->stat->time_marks(i);
 		}
 	}
 	
@@ -556,21 +577,21 @@ pair<int, double> get_likelihood_ratio_time(timed_state* target){
 	
 	/* calculating ratio and parameters */
 	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i){
-		if(target->stat->time_counts[i] < MIN_DATA && target->stat->time_marks[i] < MIN_DATA) continue;
+		if(target->stat->time_counts(i) < MIN_DATA && target->stat->time_marks(i) < MIN_DATA) continue;
 		
-		double top_probability = ((double)(target->stat->time_counts[i] + target->stat->time_marks[i]))
+		double top_probability = ((double)(target->stat->time_counts(i) + target->stat->time_marks(i)))
 		/ ((double)(total_old + total_new));
 		
 		double bottom_probability1 = 1.0;
-		if(target->stat->time_counts[i] != 0) bottom_probability1 = ((double)target->stat->time_counts[i]) / ((double)total_old);
+		if(target->stat->time_counts(i) != 0) bottom_probability1 = ((double)target->stat->time_counts(i)) / ((double)total_old);
 		
 		double bottom_probability2 = 1.0;
-		if(target->stat->time_marks[i] != 0) bottom_probability2 = ((double)target->stat->time_marks[i]) / ((double)total_new);
+		if(target->stat->time_marks(i) != 0) bottom_probability2 = ((double)target->stat->time_marks(i)) / ((double)total_new);
 		
-		ratio += (double)target->stat->time_counts[i] * log(top_probability);
-		ratio -= (double)target->stat->time_counts[i] * log(bottom_probability1);
-		ratio += (double)target->stat->time_marks[i] * log(top_probability);
-		ratio -= (double)target->stat->time_marks[i] * log(bottom_probability2);
+		ratio += (double)target->stat->time_counts(i) * log(top_probability);
+		ratio -= (double)target->stat->time_counts(i) * log(bottom_probability1);
+		ratio += (double)target->stat->time_marks(i) * log(top_probability);
+		ratio -= (double)target->stat->time_marks(i) * log(bottom_probability2);
 		extra_parameters++;
 	}
 	
@@ -594,67 +615,156 @@ pair<int, double> get_likelihood_ratio_time(timed_state* target){
 	return pair<int, double>(0, 0.0);
 };
 
+/* The table of statistics rows, STAT_CHUNK_ROWS rows per chunk. Every thread keeps the rows it freed in its own
+ * cache and only takes the lock to move STAT_ROW_BATCH rows between its cache and the table. */
+const int STAT_CHUNK_ROWS = 1024;
+const unsigned int STAT_ROW_BATCH = 64;
+
+struct stat_row_table{
+	mutex lock;
+	vector<rti_count*> chunks;
+	vector<rti_count*> free_rows;
+	int num_chunk_rows;     // used in the last chunk
+	int row_size;
+	stat_row_table() : num_chunk_rows(STAT_CHUNK_ROWS), row_size(0) {};
+	~stat_row_table(){
+		for(unsigned int i = 0; i < chunks.size(); ++i) delete[] chunks[i];
+	};
+};
+
+static stat_row_table& stat_rows(){
+	static stat_row_table table;
+	return table;
+};
+
+/* gives up to num_rows rows of the cache back to the table, unless they have another size */
+static void give_back_stat_rows(vector<rti_count*>& rows, int row_size, unsigned int num_rows){
+	stat_row_table& table = stat_rows();
+	lock_guard<mutex> guard(table.lock);
+	if(row_size == table.row_size)
+		table.free_rows.insert(table.free_rows.end(), rows.end() - num_rows, rows.end());
+	rows.resize(rows.size() - num_rows);
+};
+
+struct stat_row_cache{
+	vector<rti_count*> rows;
+	int row_size;
+	stat_row_cache() : row_size(0) {};
+	~stat_row_cache(){
+		give_back_stat_rows(rows, row_size, rows.size());
+	};
+};
+
+static inline stat_row_cache& local_stat_rows(){
+	static thread_local stat_row_cache cache;
+	return cache;
+};
+
+/* takes a batch of free rows, or cuts them from the last chunk. The row size depends on MAX_SYMBOL and
+ * NUM_HISTOGRAM_BARS, when it changes the rows of the old size are no longer handed out, but their chunks
+ * are kept until exit, so the statistics that still use them stay valid. */
+static void refill_stat_rows(stat_row_cache& cache, int row_size){
+	stat_row_table& table = stat_rows();
+	lock_guard<mutex> guard(table.lock);
+	if(row_size != table.row_size){
+		table.free_rows.clear();
+		table.num_chunk_rows = STAT_CHUNK_ROWS;
+		table.row_size = row_size;
+	}
+	unsigned int num_free = table.free_rows.size() < STAT_ROW_BATCH ? table.free_rows.size() : STAT_ROW_BATCH;
+	cache.rows.insert(cache.rows.end(), table.free_rows.end() - num_free, table.free_rows.end());
+	table.free_rows.resize(table.free_rows.size() - num_free);
+	for(; num_free < STAT_ROW_BATCH; ++num_free){
+		if(table.num_chunk_rows == STAT_CHUNK_ROWS){
+			table.chunks.push_back(new rti_count[(long long)STAT_CHUNK_ROWS * row_size]);
+			table.num_chunk_rows = 0;
+		}
+		cache.rows.push_back(table.chunks.back() + (long long)(table.num_chunk_rows++) * row_size);
+	}
+};
+
+static rti_count* allocate_stat_row(int row_size){
+	stat_row_cache& cache = local_stat_rows();
+	if(cache.row_size != row_size){
+		give_back_stat_rows(cache.rows, cache.row_size, cache.rows.size());
+		cache.row_size = row_size;
+	}
+	if(cache.rows.empty()) refill_stat_rows(cache, row_size);
+	rti_count* row = cache.rows.back();
+	cache.rows.pop_back();
+	return row;
+};
+
+static void release_stat_row(rti_count* row, int row_size){
+	stat_row_cache& cache = local_stat_rows();
+	if(row_size != cache.row_size) return;
+	cache.rows.push_back(row);
+	if(cache.rows.size() >= 2 * STAT_ROW_BATCH) give_back_stat_rows(cache.rows, row_size, STAT_ROW_BATCH);
+};
+
 /* Constructor */
 state_statistics::state_statistics(){
 	total_counts = 0;
-	symbol_counts = new int[MAX_SYMBOL];
-	for(int i = 0; i < MAX_SYMBOL; ++i) symbol_counts[i] = 0;
-	time_counts = new int[NUM_HISTOGRAM_BARS];
-	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i) time_counts[i] = 0;
-
 	total_marks = 0;
-	symbol_marks = new int[MAX_SYMBOL];
-	for(int i = 0; i < MAX_SYMBOL; ++i) symbol_marks[i] = 0;
-	time_marks = new int[NUM_HISTOGRAM_BARS];
-	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i) time_marks[i] = 0;
+	row_size = 2 * (MAX_SYMBOL + NUM_HISTOGRAM_BARS);
+	symbols = allocate_stat_row(row_size);
+	times = symbols + 2 * MAX_SYMBOL;
+	for(int i = 0; i < row_size; ++i) symbols[i] = 0;
 };
 
 /* Destructor */
 state_statistics::~state_statistics(){
-	delete[] symbol_counts;
-	delete[] time_counts;
-	delete[] symbol_marks;
-	delete[] time_marks;
+	release_stat_row(symbols, row_size);
+};
+
+void state_statistics::add_count(timed_tail tail){
+		rti_count count = tail.get_count();
+		total_counts += count;
+		symbol_counts(tail.get_symbol()) += count;
+		time_counts(get_bar(tail.get_time_value())) += count;
 };
 
-void state_statistics::add_count(timed_tail* tail){
-		total_counts++;
-		symbol_counts[tail->get_symbol()]++;
-		time_counts[get_bar(tail->get_time_value())]++;
+void state_statistics::add_counts(state_statistics* other){
+	total_counts += other->total_counts;
+	for(int i = 0; i < MAX_SYMBOL; ++i) symbol_counts(i) += other->symbol_counts(i);
+	for(int i = 0; i < NUM_HISTOGRAM_BARS; ++i) time_counts(i) += other->time_counts(i);
 };
 
-void state_statistics::del_count(timed_tail* tail){
-		total_counts--;
-		symbol_counts[tail->get_symbol()]--;
-		time_counts[get_bar(tail->get_time_value())]--;
+void state_statistics::del_count(timed_tail tail){
+		rti_count count = tail.get_count();
+		total_counts -= count;
+		symbol_counts(tail.get_symbol()) -= count;
+		time_counts(get_bar(tail.get_time_value())) -= count;
 };
 
-void state_statistics::mark(timed_tail* tail){
-		int bar_number = get_bar(tail->get_time_value());
-		total_marks++;
-		symbol_marks[tail->get_symbol()]++;
-		time_marks[bar_number]++;
-		total_counts--;
-		symbol_counts[tail->get_symbol()]--;
-		time_counts[bar_number]--;
+void state_statistics::mark(timed_tail tail){
+		int bar_number = get_bar(tail.get_time_value());
+		rti_count count = tail.get_count();
+		total_marks += count;
+		symbol_marks(tail.get_symbol()) += count;
+		time_marks(bar_number) += count;
+		total_counts -= count;
+		symbol_counts(tail.get_symbol()) -= count;
+		time_counts(bar_number) -= count;
 };
 
-void state_statistics::unmark(timed_tail* tail){
-		int bar_number = get_bar(tail->get_time_value());
-		total_marks--;
-		symbol_marks[tail->get_symbol()]--;
-		time_marks[bar_number]--;
-		total_counts++;
-		symbol_counts[tail->get_symbol()]++;
-		time_counts[bar_number]++;
+void state_statistics::unmark(timed_tail tail){
+		int bar_number = get_bar(tail.get_time_value());
+		rti_count count = tail.get_count();
+		total_marks -= count;
+		symbol_marks(tail.get_symbol()) -= count;
+		time_marks(bar_number) -= count;
+		total_counts += count;
+		symbol_counts(tail.get_symbol()) += count;
+		time_counts(bar_number) += count;
 };
 
-double state_statistics::get_probability(timed_tail* tail){
-		int bar_number = get_bar(tail->get_time_value());
-		return (double)(symbol_counts[tail->get_symbol()] * time_counts[bar_number]) / (double)(total_counts * total_counts);
+double state_statistics::get_probability(timed_tail tail){
+		int bar_number = get_bar(tail.get_time_value());
+		return (double)(symbol_counts(tail.get_symbol()) * time_counts(bar_number)) / (double)(total_counts * total_counts);
 };
 
-double state_statistics::get_mark_probability(timed_tail* tail){
-		int bar_number = get_bar(tail->get_time_value());
-		return (double)(symbol_marks[tail->get_symbol()] * time_marks[bar_number]) / (double)(total_marks * total_marks);
+double state_statistics::get_mark_probability(timed_tail tail){
+		int bar_number = get_bar(tail.get_time_value());
+		return (double)(symbol_marks(tail.get_symbol()) * time_marks(bar_number)) / (double)(total_marks * total_marks);
 };
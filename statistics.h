@@ -5,6 +5,7 @@
  *  More statistics will be added later (for instance an L-infinity norm bound like many PAC learners).
  *
  *  The sizes of the TIME histogram bins used to calculate the statistics are set to the Interquartile ranges
+ *  (or other quantiles when NUM_HISTOGRAM_BARS is not 4) of the distinct time values.
  *  These should work fine for most time distributions.
  *  The functions in this file are all called from timed_automaton.cpp (merge and split tests)
  *
@@ -32,14 +33,19 @@
 
 class state_statistics;
 
+#include <assert.h>
 #include "timed_data.h"
 #include "timed_automaton.h"
+#include "pool.h"
 
 extern double MAX_DIST;
 extern int MIN_DATA;
 extern double MAX_P_VALUE;
 extern double MIN_P_VALUE;
 
+extern thread_local vector< pair<double, int> >* TEST_TERMS;
+extern void add_test_terms(const vector< pair<double, int> >& terms, unsigned int begin, unsigned int end);
+
 extern void initialize_consensus_test();
 extern void add_to_consensus_test(double p_value);
 extern double calculate_consensus_test();
@@ -48,23 +54,40 @@ extern void initialize_likelihood_test();
 extern void add_to_likelihood_test(double ratio, int parameters);
 extern double calculate_likelihood_test();
 	
-extern double calculate_chi2_score(timed_state* old_target, timed_state* new_target);
+extern double calculate_chi2_score(state_statistics* old_stat, state_statistics* new_stat);
 extern double calculate_chi2_score(timed_state* target);
-extern double calculate_chi2_score_time(timed_state* old_target, timed_state* new_target);
+extern double calculate_chi2_score_time(state_statistics* old_stat, state_statistics* new_stat);
 extern double calculate_chi2_score_time(timed_state* target);
-extern pair<int, double> get_likelihood_ratio(timed_state* old_target, timed_state* new_target);
+extern pair<int, double> get_likelihood_ratio(state_statistics* old_stat, state_statistics* new_stat);
 extern pair<int, double> get_likelihood_ratio(timed_state* target);
-extern pair<int, double> get_likelihood_ratio_time(timed_state* old_target, timed_state* new_target);
+extern pair<int, double> get_likelihood_ratio_time(state_statistics* old_stat, state_statistics* new_stat);
 extern pair<int, double> get_likelihood_ratio_time(timed_state* target);
 
+/* The counts and marks of all states are stored in rows of one table. A row holds the count and mark of
+ * every symbol interleaved, followed by those of every histogram bar. The rows are allocated in chunks
+ * that are never moved, freed rows are reused by the same thread (see statistics.cpp). */
 class state_statistics{
-	int total_counts;
-	int* symbol_counts;
-	int* time_counts;
+	rti_count total_counts;
+	rti_count total_marks;
+	int row_size;
+	rti_count* symbols;   // the row, symbol counts at even and marks at odd positions
+	rti_count* times;     // the histogram bars in the row, laid out in the same way
+	
+	inline rti_count& symbol_counts(int s){
+		return symbols[2 * s];
+	};
+	
+	inline rti_count& symbol_marks(int s){
+		return symbols[2 * s + 1];
+	};
+	
+	inline rti_count& time_counts(int t){
+		return times[2 * t];
+	};
 	
-	int total_marks;
-	int* symbol_marks;
-	int* time_marks;
+	inline rti_count& time_marks(int t){
+		return times[2 * t + 1];
+	};
 
 	friend void initialize_consensus_test();
 	friend void add_to_consensus_test(double p_value);
@@ -74,70 +97,72 @@ class state_statistics{
 	friend void add_to_likelihood_test(double ratio, int parameters);
 	friend double calculate_likelihood_test();
 	
-	friend double calculate_chi2_score(timed_state* old_target, timed_state* new_target);
+	friend double calculate_chi2_score(state_statistics* old_stat, state_statistics* new_stat);
 	friend double calculate_chi2_score(timed_state* target);
-	friend double calculate_chi2_score_time(timed_state* old_target, timed_state* new_target);
+	friend double calculate_chi2_score_time(state_statistics* old_stat, state_statistics* new_stat);
 	friend double calculate_chi2_score_time(timed_state* target);
-	friend pair<int, double> get_likelihood_ratio(timed_state* old_target, timed_state* new_target);
+	friend pair<int, double> get_likelihood_ratio(state_statistics* old_stat, state_statistics* new_stat);
 	friend pair<int, double> get_likelihood_ratio(timed_state* target);
-	friend pair<int, double> get_likelihood_ratio_time(timed_state* old_target, timed_state* new_target);
+	friend pair<int, double> get_likelihood_ratio_time(state_statistics* old_stat, state_statistics* new_stat);
 	friend pair<int, double> get_likelihood_ratio_time(timed_state* target);
 
 public:	
+	/* taken from and returned to a pool, see pool.h */
+	static inline void* operator new(size_t size){
+		assert(size == sizeof(state_statistics));
+		return object_pool<state_statistics>::allocate();
+	};
+	
+	static inline void operator delete(void* p){
+		object_pool<state_statistics>::release(p);
+	};
+	
 	state_statistics();
 	~state_statistics();
 	
-	inline int get_time_counts(int t){
-		return time_counts[t];
+	inline rti_count get_time_counts(int t){
+		return time_counts(t);
 	};
 	
-	inline int get_symbol_counts(int s){
-		return symbol_counts[s];
+	inline rti_count get_symbol_counts(int s){
+		return symbol_counts(s);
 	};
 
-	const inline int get_bar(int time){
-		if(time <= TIME_IQR25) return 0;
-		if(time <= TIME_IQR50) return 1;
-		if(time <= TIME_IQR75) return 2;
-		return 3;
+	const inline int get_bar(rti_time time){
+		for(int bar = 0; bar < NUM_HISTOGRAM_BARS - 1; ++bar)
+			if(time <= TIME_CUT_POINTS[bar]) return bar;
+		return NUM_HISTOGRAM_BARS - 1;
 	};
 	
-	const inline int get_begin_time(int bar){
-		switch(bar){
-			case 0 : return 0;
-			case 1 : return TIME_IQR25 + 1;
-			case 2 : return TIME_IQR50 + 1;
-			default : return TIME_IQR75 + 1;
-		}
+	const inline rti_time get_begin_time(int bar){
+		if(bar == 0) return 0;
+		return TIME_CUT_POINTS[bar - 1] + 1;
 	};
 	
-	const inline int get_end_time(int bar){
-		switch(bar){
-			case 0 : return TIME_IQR25;
-			case 1 : return TIME_IQR50;
-			case 2 : return TIME_IQR75;
-			default : return MAX_TIME + 1;
-		}
+	const inline rti_time get_end_time(int bar){
+		if(bar < NUM_HISTOGRAM_BARS - 1) return TIME_CUT_POINTS[bar];
+		return MAX_TIME + 1;
 	};
 
-	void add_count(timed_tail* tail);
-	void del_count(timed_tail* tail);
-	void mark(timed_tail* tail);
-	void unmark(timed_tail* tail);
+	void add_count(timed_tail tail);
+	void add_counts(state_statistics* other);
+	void del_count(timed_tail tail);
+	void mark(timed_tail tail);
+	void unmark(timed_tail tail);
 	
 	inline void add_count(int symbol, int time){
-		symbol_counts[symbol]++;
-		time_counts[time]++;
+		symbol_counts(symbol)++;
+		time_counts(time)++;
 		total_counts++;
 	};
 	
 	inline double get_probability(int symbol, int time){
-		return (((double) symbol_counts[symbol] * time_counts[time]) / ((double)total_counts * total_counts));
+		return (((double) symbol_counts(symbol) * time_counts(time)) / ((double)total_counts * total_counts));
 	};
 
-	inline double get_probability_time(int symbol, int time){
-		double count = ((double)total_counts / 1000.0) + (double)symbol_counts[symbol];
-		double timec = ((double)total_counts / 1000.0) + (double)time_counts[get_bar(time)];
+	inline double get_probability_time(int symbol, rti_time time){
+		double count = ((double)total_counts / 1000.0) + (double)symbol_counts(symbol);
+		double timec = ((double)total_counts / 1000.0) + (double)time_counts(get_bar(time));
 		double additional_count = ((double)total_counts / 1000.0) * (double)MAX_SYMBOL;
 		double additional_time = ((double)total_counts / 1000.0) * (double)NUM_HISTOGRAM_BARS;
 		return ((count * timec) / (((double)total_counts + additional_count) * ((double)total_counts + additional_time)));
@@ -146,26 +171,26 @@ public:
 	inline void clear_marks(){
 		total_marks = 0;
 		for(int i = 0; i < MAX_SYMBOL; ++i){
-			symbol_counts[i] += symbol_marks[i];
-			symbol_marks[i] = 0;
+			symbol_counts(i) += symbol_marks(i);
+			symbol_marks(i) = 0;
 		}
 		
 		for(int j = 0; j < NUM_HISTOGRAM_BARS; ++j){
-			time_counts[j] += time_marks[j];
-			time_marks[j] = 0;
+			time_counts(j) += time_marks(j);
+			time_marks(j) = 0;
 		}
 	};
 
-	inline int get_total_counts(){
+	inline rti_count get_total_counts(){
 		return total_counts;
 	};
 
-	inline int get_total_marks(){
+	inline rti_count get_total_marks(){
 		return total_marks;
 	};
 
-	double get_probability(timed_tail* tail);	
-	double get_mark_probability(timed_tail* tail);
+	double get_probability(timed_tail tail);	
+	double get_mark_probability(timed_tail tail);
 };
 
 #endif /* _STATISTICS_H_ */
@@ -23,54 +23,136 @@
  
 #include "tail.h"
 #include <assert.h>
+#include <algorithm>
 
-void add_tail_to_set(tail_set& tails, timed_tail* tail){
-	tails.insert(pair<int, timed_tail*>(tail->get_time_value(), tail));
+const int* TAIL_SYMBOLS = 0;
+const int* TAIL_TIME_VALUES = 0;
+const timed_word* TAIL_WORD_LIST = 0;
+int* TAIL_WORDS = 0;
+char* TAIL_FLAGS = 0;
+unsigned int* TAIL_SLOTS = 0;
+
+void add_tail_to_set(tail_set& tails, timed_tail tail){
+	tails.insert(tail);
 };
 
-void del_tail_from_set(tail_set& tails, timed_tail* tail){
-	pair<tail_it, tail_it> it_pair = tails.equal_range(tail->get_time_value());
-	for(tail_it it = it_pair.first; it != it_pair.second; ++it){
-		if((*it).second == tail){
-			tails.erase(it);
-			return;
-		}
-	}
-	assert(0);
+void del_tail_from_set(tail_set& tails, timed_tail tail){
+	tails.erase(tail);
+};
+
+bool contains_tail_in_set(tail_set& tails, timed_tail tail){
+	return tails.contains(tail);
+};
+
+static inline bool earlier_tail(const tail_entry& a, const tail_entry& b){
+	return a.first < b.first;
 };
 
-bool contains_tail_in_set(tail_set& tails, timed_tail* tail){
-	pair<tail_it, tail_it> it_pair = tails.equal_range(tail->get_time_value());
-	for(tail_it it = it_pair.first; it != it_pair.second; ++it){
-		if((*it).second == tail){
-			return true;
-		}
+static inline bool is_hole(const tail_entry& e){
+	return e.second.get_position() == NO_TAIL;
+};
+
+void tail_set::set_slots(unsigned int begin){
+	for(unsigned int slot = begin; slot < entries.size(); ++slot)
+		if(!is_hole(entries[slot])) TAIL_SLOTS[entries[slot].second.get_position()] = slot;
+};
+
+/* removes the holes and sorts the appended entries into the sorted ones */
+void tail_set::sort_entries(){
+	if(num_sorted == entries.size() && num_holes == 0) return;
+	unsigned int size = 0;
+	unsigned int sorted = 0;
+	for(unsigned int slot = first; slot < entries.size(); ++slot){
+		if(!is_hole(entries[slot])) entries[size++] = entries[slot];
+		if(slot + 1 == num_sorted) sorted = size;
 	}
-	return false;
+	entries.erase(entries.begin() + size, entries.end());
+	stable_sort(entries.begin() + sorted, entries.end(), earlier_tail);
+	inplace_merge(entries.begin(), entries.begin() + sorted, entries.end(), earlier_tail);
+	first = 0;
+	num_sorted = size;
+	num_holes = 0;
+	set_slots(0);
 };
 
-timed_tail::timed_tail(timed_word* w, int i, timed_tail* t){
-	word = w;
-	index = i;
-	length = w->get_length() - index;
-	next = 0;
-	prev = t;
-	if(t != 0) t->next = this;
-	marker = false;
+unsigned int tail_set::find_slot(timed_tail tail) const{
+	unsigned int slot = TAIL_SLOTS[tail.get_position()];
+	if(slot >= first && slot < entries.size() && entries[slot].second == tail) return slot;
+	
+	tail_entry key(tail.get_time_value(), tail);
+	vector<tail_entry>::const_iterator it = lower_bound(entries.begin() + first, entries.begin() + num_sorted, key, earlier_tail);
+	for(; it != entries.begin() + num_sorted && (*it).first == key.first; ++it)
+		if((*it).second == tail) return it - entries.begin();
+	for(slot = num_sorted; slot < entries.size(); ++slot)
+		if(entries[slot].second == tail) return slot;
+	return entries.size();
 };
 
-timed_tail::~timed_tail(){
-	if(next != 0)
-		delete next;
+tail_set::const_iterator tail_set::upper_bound(rti_time time){
+	sort_entries();
+	tail_entry key(time, timed_tail());
+	return const_iterator(this, std::upper_bound(entries.begin() + first, entries.end(), key, earlier_tail) - entries.begin());
+};
+
+void tail_set::insert(timed_tail tail){
+	tail_entry entry(tail.get_time_value(), tail);
+	bool sorted = num_sorted == entries.size() && (num_sorted == first || entries[num_sorted - 1].first <= entry.first);
+	TAIL_SLOTS[tail.get_position()] = entries.size();
+	entries.push_back(entry);
+	if(sorted) num_sorted++;
+};
+
+void tail_set::erase(timed_tail tail){
+	unsigned int slot = find_slot(tail);
+	assert(slot != entries.size());
+	entries[slot].second = timed_tail();
+	num_holes++;
+};
+
+/* other is sorted first, so iterating it later does not take the slots of its tails back */
+void tail_set::insert(tail_set& other){
+	if(other.empty()) return;
+	other.sort_entries();
+	bool sorted = num_sorted == entries.size() && (num_sorted == first || entries.back().first <= other.entries[other.first].first);
+	unsigned int begin = entries.size();
+	entries.insert(entries.end(), other.entries.begin() + other.first, other.entries.end());
+	set_slots(begin);
+	if(sorted) num_sorted = entries.size();
+};
+
+void tail_set::erase(tail_set& other){
+	for(unsigned int slot = other.first; slot < other.entries.size(); ++slot)
+		if(!is_hole(other.entries[slot])) erase(other.entries[slot].second);
+	other.set_slots(other.first);
+};
+
+void tail_set::split(rti_time time, tail_set& lower){
+	assert(lower.entries.empty());
+	sort_entries();
+	tail_entry key(time, timed_tail());
+	unsigned int slot = std::upper_bound(entries.begin() + first, entries.end(), key, earlier_tail) - entries.begin();
+	if(slot - first <= entries.size() - slot){
+		lower.entries.assign(entries.begin() + first, entries.begin() + slot);
+		lower.set_slots(0);
+		first = slot;
+	} else {
+		lower.entries.swap(entries);
+		lower.first = first;
+		entries.assign(lower.entries.begin() + slot, lower.entries.end());
+		lower.entries.resize(slot);
+		first = 0;
+		set_slots(0);
+	}
+	lower.num_sorted = lower.entries.size();
+	num_sorted = entries.size();
 };
 
 const string timed_tail::to_str() const{
 	ostringstream ostr;
 	ostr << "(" << get_symbol() << "," << get_time_value() << ")";
-	const timed_tail *nt = next;
-	while(nt != 0){
-		ostr << nt->get_symbol();
-		nt = nt->next;
+	for(timed_tail nt = *this; nt.has_next_tail(); ){
+		nt = nt.next_tail();
+		ostr << nt.get_symbol();
 	}
 	return ostr.str();
 };
@@ -25,106 +25,241 @@
 #define _TAIL_H_
 
 
-#include <map>
+#include <vector>
 #include <sstream>
+#include <limits.h>
 #include "timed_data.h"
 
 using namespace std;
 
 class timed_tail;
-typedef multimap<int, timed_tail*> tail_set;
-typedef multimap<int, timed_tail*>::iterator tail_it;
-typedef multimap<int, timed_tail*>::const_iterator const_tail_it;
+class tail_set;
 
-void add_tail_to_set(tail_set&, timed_tail*);
-void del_tail_from_set(tail_set&, timed_tail*);
-bool contains_tail_in_set(tail_set& tails, timed_tail* tail);
+void add_tail_to_set(tail_set&, timed_tail);
+void del_tail_from_set(tail_set&, timed_tail);
+bool contains_tail_in_set(tail_set& tails, timed_tail tail);
 
+/* The columns of the input the tails point into, set by timed_automaton(timed_input*).
+ * Position p is an entry of the symbol and time columns (see timed_input), TAIL_WORDS[p] is the
+ * number of its word and TAIL_FLAGS[p] holds the TAIL_MARKED and TAIL_LAST bits of the tail starting at p. */
+extern const int* TAIL_SYMBOLS;
+extern const int* TAIL_TIME_VALUES;
+extern const timed_word* TAIL_WORD_LIST;
+extern int* TAIL_WORDS;
+extern char* TAIL_FLAGS;
+/* the slot of every tail in the tail_set it was last added to (see tail_set) */
+extern unsigned int* TAIL_SLOTS;
+
+/* the position of no tail, used for the deleted entries of a tail_set */
+const unsigned int NO_TAIL = UINT_MAX;
+
+const char TAIL_MARKED = 1;
+const char TAIL_LAST   = 2;
+
+/* a tail is a 32-bit handle, the position of its first symbol in the columns,
+ * the next tail of the same timed string starts at the next position */
 class timed_tail{
-	timed_word  *word;
-	int          index;
-	int 		 length;
-	
-	timed_tail *next;
-	timed_tail *prev;
-	
-	friend class timed_input;
-	
-	friend void add_tail(tail_set&, timed_tail*);
-	friend void del_tail(tail_set&, timed_tail*);
+	unsigned int position;
 	
 public:
-	bool marker;
-
-	/* constructs a tail from the specified arguments */
-	timed_tail(timed_word *, int, timed_tail *);
-	~timed_tail();
+	/* constructs the tail starting at position p */
+	explicit timed_tail(unsigned int p) : position(p) {};
+	timed_tail() : position(NO_TAIL) {};
 
 	/* used for printing */
 	const string to_str() const;
 	
 	/* get methods */
-	inline const timed_word	*get_word() const{
-		return word;
+	inline unsigned int get_position() const{
+		return position;
+	};
+	
+	inline const timed_word *get_word() const{
+		return TAIL_WORD_LIST + TAIL_WORDS[position];
 	};
 	
 	inline int get_index() const{
-		return index;
+		return (TAIL_SYMBOLS + position) - get_word()->get_symbols();
 	};
 
 	inline int get_length() const{
-		return length;
+		return get_word()->get_length() - get_index();
+	};
+	
+	/* the number of identical timed strings this tail stands for */
+	inline rti_count get_count() const{
+		return get_word()->get_count();
 	};
 
 	inline int get_symbol() const{
-		return word->get_symbols()[index];
+		return TAIL_SYMBOLS[position];
 	};
 	
-	inline char get_char_symbol() const{
-		return word->get_char_symbols()[index];
-	};
-
 	inline const int* get_symbols() const{
-		return &(word->get_symbols()[index]);
+		return TAIL_SYMBOLS + position;
 	};
 	
-	inline const char* get_char_symbols() const{
-		return &(word->get_char_symbols()[index]);
+	inline rti_time get_time_value() const{
+#ifdef RTI_WIDE
+		return TIME_VALUES[TAIL_TIME_VALUES[position]];
+#else
+		return TAIL_TIME_VALUES[position];
+#endif
 	};
-
-	inline int get_time_value() const{
-		return word->get_time_values()[index];
+	
+	inline rti_time get_time_value(int i) const{
+		if(i < get_length())
+			return timed_tail(position + i).get_time_value();
+		return -1;
 	};
 	
-    inline int get_time_value(int i) const{
-        if(i < length)
-            return word->get_time_values()[index + i];
-        return -1;
-    };
-
-	inline const int* get_time_values() const{
-		return &(word->get_time_values()[index]);
+	inline bool has_next_tail() const{
+		return (TAIL_FLAGS[position] & TAIL_LAST) == 0;
+	};
+	
+	inline bool has_prev_tail() const{
+		return get_index() != 0;
 	};
 	
-	inline timed_tail *next_tail() const{
-		return next;
+	inline timed_tail next_tail() const{
+		return timed_tail(position + 1);
 	};
 	
-	inline timed_tail *prev_tail() const{
-		return prev;
+	inline timed_tail prev_tail() const{
+		return timed_tail(position - 1);
 	};
 	
 	inline void mark(){
-		marker = true;
+		TAIL_FLAGS[position] |= TAIL_MARKED;
 	};
 	
 	inline void un_mark(){
-		marker = false;
+		TAIL_FLAGS[position] &= ~TAIL_MARKED;
+	};
+	
+	inline bool is_marked() const{
+		return (TAIL_FLAGS[position] & TAIL_MARKED) != 0;
+	};
+	
+	inline bool operator==(const timed_tail& other) const{
+		return position == other.position;
+	};
+	
+	inline bool operator!=(const timed_tail& other) const{
+		return position != other.position;
+	};
+};
+
+typedef pair<rti_time, timed_tail> tail_entry;
+
+/* The tails of an interval, ordered by time value, tails with equal time values in the order they were added.
+ * This is a sorted vector: added tails are appended and sorted into it (stable) when the set is next
+ * iterated or split, deleted tails leave a hole (NO_TAIL) until then. Deleting a tail finds its slot
+ * through TAIL_SLOTS. A tail can be in several sets (during a merge), its slot is that of the set it was
+ * last added to, erase(other) gives the tails of other their slots in other again. Only when a slot
+ * is not in the set (a target built after a merge took it), the tail is looked up by binary search.
+ * Iterating skips the holes, tails that are added during an iteration are not visited. The entries
+ * before first have been split off. */
+class tail_set{
+	vector<tail_entry> entries;
+	unsigned int first;
+	unsigned int num_sorted;    // entries[first, num_sorted) are sorted, the others have been appended
+	unsigned int num_holes;
+	
+	void sort_entries();
+	void set_slots(unsigned int first);
+	unsigned int find_slot(timed_tail tail) const;
+	
+public:
+	class const_iterator{
+		const tail_set* set;
+		unsigned int slot;
+		
+		friend class tail_set;
+		const_iterator(const tail_set* s, unsigned int i) : set(s), slot(i) {
+			skip_holes();
+		};
+		
+		inline void skip_holes(){
+			while(slot < set->num_sorted && set->entries[slot].second.get_position() == NO_TAIL) ++slot;
+		};
+		
+	public:
+		const_iterator() : set(0), slot(0) {};
+		
+		inline const tail_entry& operator*() const{
+			return set->entries[slot];
+		};
+		
+		inline const tail_entry* operator->() const{
+			return &set->entries[slot];
+		};
+		
+		inline const_iterator& operator++(){
+			++slot;
+			skip_holes();
+			return *this;
+		};
+		
+		inline bool operator==(const const_iterator& other) const{
+			return slot == other.slot;
+		};
+		
+		inline bool operator!=(const const_iterator& other) const{
+			return slot != other.slot;
+		};
+	};
+	typedef const_iterator iterator;
+	
+	tail_set() : first(0), num_sorted(0), num_holes(0) {};
+	
+	inline const_iterator begin(){
+		sort_entries();
+		return const_iterator(this, first);
+	};
+	
+	inline const_iterator end() const{
+		return const_iterator(this, num_sorted);
 	};
 	
-	inline bool is_marked(){
-		return marker;
+	/* calls f(tail) for every tail, in no particular order, without sorting the set, so the set is
+	 * not changed and several threads can do this at the same time */
+	template <class F> inline void for_each(F f) const{
+		for(unsigned int slot = first; slot < entries.size(); ++slot)
+			if(entries[slot].second.get_position() != NO_TAIL) f(entries[slot].second);
 	};
+	
+	/* the first tail with a time value larger than time */
+	const_iterator upper_bound(rti_time time);
+	
+	inline bool empty() const{
+		return entries.size() - first == num_holes;
+	};
+	
+	/* the number of tails, not counting duplicates */
+	inline unsigned int size() const{
+		return entries.size() - first - num_holes;
+	};
+	
+	void insert(timed_tail tail);
+	void erase(timed_tail tail);
+	
+	inline bool contains(timed_tail tail) const{
+		return find_slot(tail) != entries.size();
+	};
+	
+	/* adds all tails of other after the ones in this set, does not remove them from other */
+	void insert(tail_set& other);
+	
+	/* removes the tails of other, which were added by insert(other) */
+	void erase(tail_set& other);
+	
+	/* moves the tails with a time value of at most time into the empty set lower,
+	 * the fewer of the lower and higher tails are copied, the others stay in their slots */
+	void split(rti_time time, tail_set& lower);
 };
 
+typedef tail_set::iterator tail_it;
+typedef tail_set::const_iterator const_tail_it;
+
 #endif /* _TAIL_H_*/
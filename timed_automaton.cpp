@@ -28,53 +28,177 @@
 #include <string>
 #include <stdio.h>
 #include "timed_automaton.h"
+#include "parallel.h"
+#include "traversal.h"
 #include <assert.h>
+#include <limits.h>
+#include <algorithm>
 
 int TEST_TYPE = 0;
+bool LAZY_TREE = false;
+bool SHARDED_TREE = false;
+
+interval_set EMPTY_INTERVALS;
 
 timed_automaton::timed_automaton(){
+	create_interval_set(EMPTY_INTERVALS);
 	root = new timed_state();
-	states.push_back(root);
+	add_state(root);
 	input = 0;
+	tail_words = 0;
+	tail_flags = 0;
+	tail_slots = 0;
+};
+
+/* the minimum number of strings in a range of the strings whose tails are initialized by one thread */
+const int MIN_TAIL_RANGE = 1024;
+
+/* fills TAIL_WORDS, TAIL_FLAGS and TAIL_SLOTS for the tails of a contiguous range of the strings */
+struct tail_task{
+	timed_input* input;
+	int num_ranges;
+	tail_task(timed_input* in, int n) : input(in), num_ranges(n) {};
+
+	void operator()(int range){
+		int first = ((long long)input->get_num_words() * range) / num_ranges;
+		int last = ((long long)input->get_num_words() * (range + 1)) / num_ranges;
+		for(int i = first; i < last; ++i){
+			const timed_word* word = input->get_word(i);
+			unsigned int position = word->get_symbols() - TAIL_SYMBOLS;
+			/* an empty string has a single tail, at its end symbol */
+			int num_tails = word->get_length() > 1 ? word->get_length() : 1;
+			for(int index = 0; index < num_tails; ++index){
+				TAIL_WORDS[position + index] = i;
+				TAIL_FLAGS[position + index] = 0;
+				TAIL_SLOTS[position + index] = NO_TAIL;
+			}
+			TAIL_FLAGS[position + num_tails - 1] = TAIL_LAST;
+		}
+	};
 };
 
+/* builds the prefix tree of a contiguous range of the strings (a shard), whose tails have been initialized */
+struct shard_task{
+	timed_input* input;
+	vector<timed_state*>& roots;
+	shard_task(timed_input* in, vector<timed_state*>& r) : input(in), roots(r) {};
+
+	void operator()(int shard){
+		int num_shards = roots.size();
+		int first = ((long long)input->get_num_words() * shard) / num_shards;
+		int last = ((long long)input->get_num_words() * (shard + 1)) / num_shards;
+		timed_state* root = new timed_state();
+		for(int i = first; i < last; ++i)
+			if(input->get_word(i)->get_length() != 0) root->add_tail(timed_tail(input->get_word(i)->get_symbols() - TAIL_SYMBOLS));
+		if(!LAZY_TREE) root->create_states();
+		roots[shard] = root;
+	};
+};
+
+/* merges shard shard + step into shard shard, for every shard that is a multiple of 2 * step */
+struct merge_shard_task{
+	vector<timed_state*>& roots;
+	int step;
+	merge_shard_task(vector<timed_state*>& r, int s) : roots(r), step(s) {};
+
+	void operator()(int i){
+		int shard = i * 2 * step;
+		roots[shard]->merge_tree(roots[shard + step]);
+		roots[shard + step] = 0;
+	};
+};
+
+/* the tails are initialized in parallel, the root gets the first tail of every string
+ * in the order of the strings and the prefix tree is built below it level by level,
+ * or only the root's children in LAZY_TREE mode (by add_state). In SHARDED_TREE mode
+ * the ranges of the strings are the shards, their trees are merged later into earlier ones. */
 timed_automaton::timed_automaton(timed_input* in){
-	root = new timed_state();
-	states.push_back(root);
+	create_interval_set(EMPTY_INTERVALS);
 	input = in;
+	tail_words = 0;
+	tail_flags = 0;
+	tail_slots = 0;
 	
+	if(in->get_num_words() != 0){
+		/* the words are stored back to back in the columns, every one followed by its end symbol */
+		TAIL_WORD_LIST = in->get_word(0);
+		TAIL_SYMBOLS = in->get_word(0)->get_symbols();
+		TAIL_TIME_VALUES = in->get_word(0)->get_time_values();
+		long long num_positions = 0;
+		for(int i = 0; i < in->get_num_words(); ++i){
+			long long end = (in->get_word(i)->get_symbols() - TAIL_SYMBOLS) + in->get_word(i)->get_length() + 1;
+			if(end > num_positions) num_positions = end;
+		}
+		assert(num_positions < (long long)UINT_MAX);
+		tail_words = new int[num_positions];
+		tail_flags = new char[num_positions];
+		tail_slots = new unsigned int[num_positions];
+		TAIL_WORDS = tail_words;
+		TAIL_FLAGS = tail_flags;
+		TAIL_SLOTS = tail_slots;
+	}
+	
+	int num_ranges = in->get_num_words() / MIN_TAIL_RANGE;
+	if(num_ranges > NUM_THREADS) num_ranges = NUM_THREADS;
+	if(num_ranges < 1) num_ranges = 1;
+	tail_task fill_task(in, num_ranges);
+	parallel_for(num_ranges, fill_task);
+	
+	if(SHARDED_TREE && num_ranges > 1){
+		vector<timed_state*> roots(num_ranges, (timed_state*)0);
+		shard_task build_task(in, roots);
+		parallel_for(num_ranges, build_task);
+		for(int step = 1; step < num_ranges; step *= 2){
+			merge_shard_task merge_task(roots, step);
+			parallel_for((num_ranges - step + 2 * step - 1) / (2 * step), merge_task);
+		}
+		root = roots[0];
+		add_state(root);
+		return;
+	}
+	
+	root = new timed_state();
 	for(int i = 0; i < in->get_num_words(); ++i){
-	 	timed_tail* tail = new timed_tail(in->get_word(i), 0, 0);
-	 	timed_tail* prev_tail = tail;
-	    for(int index = 1; index < in->get_word(i)->get_length(); ++index)
-	    	prev_tail = new timed_tail(in->get_word(i), index, prev_tail);
-
-		if(tail->get_symbol() != 10000) root->add_tail(tail);
+		/* an empty string has no tails, its only entry is the end symbol (in the wide build without a time value) */
+		if(in->get_word(i)->get_length() != 0) root->add_tail(timed_tail(in->get_word(i)->get_symbols() - TAIL_SYMBOLS));
 	}
-	root->create_states();
+	if(!LAZY_TREE) root->create_states();
+	add_state(root);
 };
 
 timed_automaton::~timed_automaton(){
 	for(state_list::iterator it = states.begin(); it != states.end(); ++it)
 		delete *it;
+	delete[] tail_words;
+	delete[] tail_flags;
+	delete[] tail_slots;
 };
 
-void timed_automaton::check_next_tail(interval* in, timed_tail* tail){
-	assert(in->get_begin() <= tail->get_time_value());
-	assert(in->get_end()   >= tail->get_time_value());
+string pool_usage(){
+	ostringstream ostr;
+	ostr << "pools (used/allocated): states " << object_pool<timed_state>::get_num_used() << "/" << object_pool<timed_state>::get_num_allocated()
+		<< ", statistics " << object_pool<state_statistics>::get_num_used() << "/" << object_pool<state_statistics>::get_num_allocated()
+		<< ", intervals " << object_pool<interval>::get_num_used() << "/" << object_pool<interval>::get_num_allocated()
+		<< ", interval sets " << object_pool<interval_set>::get_num_used() << "/" << object_pool<interval_set>::get_num_allocated() << endl;
+	return ostr.str();
+};
+
+void timed_automaton::check_next_tail(interval* in, timed_tail tail){
+	assert(in->get_begin() <= tail.get_time_value());
+	assert(in->get_end()   >= tail.get_time_value());
 	assert(in->contains_tail(tail));
-	assert(!tail->is_marked());
-	if(tail->next_tail() != 0){
-		assert(in->get_target() != 0);
-		interval* next_in = in->get_target()->get_interval(tail->next_tail()->get_symbol(), tail->next_tail()->get_time_value());
-		assert(next_in->contains_tail(tail->next_tail()));
-		assert(next_in->get_begin() <= tail->next_tail()->get_time_value());
-		assert(next_in->get_end()   >= tail->next_tail()->get_time_value());
+	assert(!tail.is_marked());
+	if(tail.has_next_tail()){
+		if(in->get_target() == 0) return;
+		interval* next_in = in->get_target()->get_interval(tail.next_tail().get_symbol(), tail.next_tail().get_time_value());
+		assert(next_in->contains_tail(tail.next_tail()));
+		assert(next_in->get_begin() <= tail.next_tail().get_time_value());
+		assert(next_in->get_end()   >= tail.next_tail().get_time_value());
 		if(!contains_state(in->get_target())){
 			assert(in->get_target()->stat->get_total_marks() == 0);
 			assert(next_in->get_begin() == MIN_TIME);
 			assert(next_in->get_end() == MAX_TIME);
-			timed_automaton::check_next_tail(next_in, tail->next_tail());
+			timed_automaton::check_next_tail(next_in, tail.next_tail());
 		}
 	} 
 };
@@ -86,7 +210,7 @@ void timed_automaton::check_consistency(){
 	for(state_list::iterator it1 = states.begin(); it1 != states.end(); ++it1){
 		timed_state* state = *it1;
 		assert(state->stat->get_total_marks() == 0);
-		for(int i = 0; i < MAX_SYMBOL; ++i){
+		for(int i = state->first_symbol(); i < MAX_SYMBOL; i = state->next_symbol(i)){
 			for(interval_it it2 = state->get_intervals(i).begin(); it2 != state->get_intervals(i).end(); ++it2){
 				interval* in = (*it2).second;
 				assert(in->get_num_marked() == 0);
@@ -94,11 +218,11 @@ void timed_automaton::check_consistency(){
 					assert(in->get_begin() <= (*it3).first);
 					assert(in->get_end()   >= (*it3).first);
 					assert(in->contains_tail((*it3).second));
-					timed_tail* tail = (*it3).second;
-					assert(!tail->is_marked());
-					if(tail->next_tail() != 0){
+					timed_tail tail = (*it3).second;
+					assert(!tail.is_marked());
+					if(tail.has_next_tail()){
 						assert(in->get_target() != 0);
-						timed_automaton::check_next_tail(in->get_target()->get_interval(tail->next_tail()->get_symbol(), tail->next_tail()->get_time_value()), tail->next_tail());
+						timed_automaton::check_next_tail(in->get_target()->get_interval(tail.next_tail().get_symbol(), tail.next_tail().get_time_value()), tail.next_tail());
 					} 
 				}
 			}
@@ -108,9 +232,10 @@ void timed_automaton::check_consistency(){
 
 void timed_automaton::recursive_tree_automaton(timed_state* st, timed_state* garbage_state){
 	add_state(st);
-	for(int s = 0; s < MAX_SYMBOL; ++s){
+	for(int s = st->first_symbol(); s < MAX_SYMBOL; s = st->next_symbol(s)){
 		for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
 			interval* in = (*it2).second;
+			if(in->get_target() == 0 && !in->is_empty()) timed_state::build_target(in);
 			if(in->get_target() == 0) in->set_target(garbage_state);
 			
 			if(in->is_empty()) continue;
@@ -119,17 +244,22 @@ void timed_automaton::recursive_tree_automaton(timed_state* st, timed_state* gar
 	}
 };
 
+/* the intervals without a target point to a garbage state, the unused symbols of a state keep no target
+ * (they read as EMPTY_INTERVALS), which also stands for the garbage state, the subtrees below the states
+ * are added to states, so these are visited by number */
 void timed_automaton::tree_automaton(){
 	timed_state* garbage_state = new timed_state();
 	for(int i = 0; i < MAX_SYMBOL; ++i){
 		garbage_state->point(i, 0, garbage_state);
 	}
 
-	for(state_it it = get_states().begin(); it != get_states().end(); ++it){
-		timed_state* st = *it;
-		for(int s = 0; s < MAX_SYMBOL; ++s){
+	int num_merged = num_states();
+	for(int number = 0; number < num_merged; ++number){
+		timed_state* st = get_state(number);
+		for(int s = st->first_symbol(); s < MAX_SYMBOL; s = st->next_symbol(s)){
 			for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
 				interval* in = (*it2).second;
+				if(in->get_target() == 0 && !in->is_empty()) timed_state::build_target(in);
 				if(in->get_target() == 0) in->set_target(garbage_state);
 				else{
 					if(contains_state(in->get_target()) || in->is_empty()) continue;
@@ -143,9 +273,10 @@ void timed_automaton::tree_automaton(){
 
 int timed_automaton::recursive_total_num_states(timed_state* st){
 	int result = 1;
-	for(int s = 0; s < MAX_SYMBOL; ++s){
+	for(int s = st->first_symbol(); s < MAX_SYMBOL; s = st->next_symbol(s)){
 		for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
 			interval* in = (*it2).second;
+			if(in->get_target() == 0 && !in->is_empty()) timed_state::build_target(in);
 			if(in->get_target() == 0 || in->get_target() == st) continue;
 			result += recursive_total_num_states(in->get_target());
 		}
@@ -158,9 +289,10 @@ int timed_automaton::total_num_states(){
 	for(state_it it = get_states().begin(); it != get_states().end(); ++it){
 		result++;
 		timed_state* st = *it;
-		for(int s = 0; s < MAX_SYMBOL; ++s){
+		for(int s = st->first_symbol(); s < MAX_SYMBOL; s = st->next_symbol(s)){
 			for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
 				interval* in = (*it2).second;
+				if(in->get_target() == 0 && !in->is_empty()) timed_state::build_target(in);
 				if(in->get_target() == 0) continue;
 				if(contains_state(in->get_target())) continue;
 
@@ -177,7 +309,7 @@ int timed_automaton::get_size(){
 		for(int s = 0; s < MAX_SYMBOL; ++s){
 			timed_state* prev_state = 0;
 			bool first = true;
-			for(const_interval_it it2 = (*it)->get_intervals(s).begin(); it2 != (*it)->get_intervals(s).end(); ++it2){
+			for(const_interval_it it2 = (*it)->find_intervals(s).begin(); it2 != (*it)->find_intervals(s).end(); ++it2){
 				interval* in = (*it2).second;
 				if(!first && in->get_target() == prev_state) continue;
 				result++;
@@ -196,6 +328,8 @@ void timed_automaton::garbage_automaton(){
 	}
 };
 
+/* reads the transitions of an automaton, those to unknown states point to a garbage state,
+ * the symbols that are not read for a state keep no target as in tree_automaton */
 void timed_automaton::from_file(FILE * str){
 	assert(states.size() == 1);
 	for(int i = 0; i < MAX_SYMBOL; ++i){
@@ -208,11 +342,13 @@ void timed_automaton::from_file(FILE * str){
 	}
 	
 	while(!feof(str)){
-		int source_state, begin_time, end_time, target_state, num_strings;
+		int source_state, target_state;
+		long long begin_time, end_time, num_strings;
 		float probability;
-		char symbol;
-		int num_conversions = fscanf(str, "%d %c [%d, %d]->%d #%d p=%f\n", &source_state, &symbol, &begin_time, &end_time, &target_state, &num_strings, &probability);
+		char symbol_name[256];
+		int num_conversions = fscanf(str, "%d %255s [%lld, %lld]->%d #%lld p=%f\n", &source_state, symbol_name, &begin_time, &end_time, &target_state, &num_strings, &probability);
 		if(num_conversions != 7) return;
+		string symbol(symbol_name);
 		
 		if(get_alph_int(symbol) != -1){
 			while(get_state(source_state) == 0) add_state(new timed_state());
@@ -239,7 +375,7 @@ void timed_automaton::from_file(FILE * str){
 	
 	for(state_it it = get_states().begin(); it != get_states().end(); ++it){
 		timed_state* st = *it;
-		for(int s = 0; s < MAX_SYMBOL; ++s){
+		for(int s = st->first_symbol(); s < MAX_SYMBOL; s = st->next_symbol(s)){
 			for(const_interval_it it2 = st->get_intervals(s).begin(); it2 != st->get_intervals(s).end(); ++it2){
 				if(get_number((*it2).second->get_target()) == -1 && (*it2).second->get_target() != garbage_state){
 					st->point(s, (*it2).second->get_begin(), garbage_state);
@@ -276,7 +412,7 @@ string timed_state::to_str_full(timed_automaton* ta){
 	}
 	ostr << endl;
 	for(int i = 0; i < MAX_SYMBOL; ++i){
-		for(const_interval_it it = targets[i].begin(); it != targets[i].end(); ++it){
+		for(const_interval_it it = find_intervals(i).begin(); it != find_intervals(i).end(); ++it){
 			ostr << ta->get_number(this) << " "  << i
 			<< " [" << (*it).second->get_begin()
 			<< ", ";
@@ -290,37 +426,37 @@ string timed_state::to_str_full(timed_automaton* ta){
 string timed_state::to_str(timed_automaton* ta){
 	ostringstream ostr;
 	double total_size = 0.0;
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		for(const_interval_it it = targets[i].begin(); it != targets[i].end(); ++it){
-		  total_size += (*it).second->tails.size();
+	for(int i = first_symbol(); i < MAX_SYMBOL; i = next_symbol(i)){
+		for(const_interval_it it = get_intervals(i).begin(); it != get_intervals(i).end(); ++it){
+		  total_size += (*it).second->get_size();
 		}
 	}
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		const_interval_it prev_it = targets[i].begin();
-		int prev_time = -1;
-		int prev_size = 0;
-		for(const_interval_it it = targets[i].begin(); it != targets[i].end(); ++it){
-		  if((*it).second->tails.size() != 0){
+	for(int i = first_symbol(); i < MAX_SYMBOL; i = next_symbol(i)){
+		const_interval_it prev_it = get_intervals(i).begin();
+		rti_time prev_time = -1;
+		rti_count prev_size = 0;
+		for(const_interval_it it = get_intervals(i).begin(); it != get_intervals(i).end(); ++it){
+		  if((*it).second->get_size() != 0){
 				if((*prev_it).second->get_target() != (*it).second->get_target()){
 					if(prev_size != 0){
-						ostr << ta->get_number(this) << " "  << ta->get_alph_char(i)
+						ostr << ta->get_number(this) << " "  << ta->get_alph_name(i)
 						<< " [" << (*prev_it).second->get_begin()
 						<< ", ";
 						ostr << prev_time
 							<< "]->" << ta->get_number((*prev_it).second->get_target());
 						ostr << " #" << prev_size << " p=" << ((double)prev_size / (double)total_size) << "\n";
 					}
-					prev_size = (*it).second->tails.size();
+					prev_size = (*it).second->get_size();
 					prev_time = (*it).second->get_end();
 					prev_it = it;
 				} else {
-					prev_size += (*it).second->tails.size(); 
+					prev_size += (*it).second->get_size(); 
 					prev_time = (*it).second->get_end();
 				}
 			}
 		}
 		if(prev_size != 0){
-			ostr << ta->get_number(this) << " "  << ta->get_alph_char(i)
+			ostr << ta->get_number(this) << " "  << ta->get_alph_name(i)
 			<< " [" << (*prev_it).second->get_begin()
 			<< ", ";
 			ostr << prev_time
@@ -331,30 +467,27 @@ string timed_state::to_str(timed_automaton* ta){
 	return ostr.str();
 };
 
+/* a state starts without used symbols, the interval set of a symbol is created when it is used */
 timed_state::timed_state(){
-	targets = new interval_set[MAX_SYMBOL];
-	for(int i = 0; i < MAX_SYMBOL; ++i)
-		create_interval_set(targets[i]);
-		
+	number = -1;
+	symbol_mask = 0;
 	stat = new state_statistics();
 }
 
 timed_state::timed_state(timed_state* state){
+	number = -1;
+	symbol_mask = 0;
 	stat = new state_statistics();
 
-	targets = new interval_set[MAX_SYMBOL];
-	for(int i = 0; i < MAX_SYMBOL; ++i)
-		create_interval_set(targets[i]);
-	
-	for(int i = 0; i < MAX_SYMBOL; ++i){
+	for(int i = state->first_symbol(); i < MAX_SYMBOL; i = state->next_symbol(i)){
 		for(interval_it it = state->get_intervals(i).begin(); it != state->get_intervals(i).end(); ++it){
 			interval* in = (*it).second;
 			if(in->get_end() != MAX_TIME)
-				split_set(targets[i], in->get_end());
+				split_set(get_intervals(i), in->get_end());
 		}
 	}
 
-	for(int i = 0; i < MAX_SYMBOL; ++i){
+	for(int i = state->first_symbol(); i < MAX_SYMBOL; i = state->next_symbol(i)){
 		interval_it it1 = get_intervals(i).begin();
 		interval_it it2 = state->get_intervals(i).begin();
 		while(it1 != get_intervals(i).end()){
@@ -365,199 +498,349 @@ timed_state::timed_state(timed_state* state){
 	}
 }
 
-void timed_state::create_states(){
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		for(interval_it it = targets[i].begin(); it != targets[i].end(); ++it){
+/* creates the target of the unbuilt interval in and gives it the next tails, the intervals of the target are unbuilt,
+ * marked tails (of a split test) are marked in the target */
+timed_state* timed_state::build_target(interval* in){
+	assert(in->to == 0 && !in->is_empty());
+	in->to = new timed_state();
+	for(const_tail_it it = in->get_tails().begin(); it != in->get_tails().end(); ++it){
+		timed_tail tail = (*it).second;
+		if(tail.has_next_tail()) in->to->add_tail(tail.next_tail());
+	}
+	if(in->get_num_marked() != 0){
+		for(const_tail_it it = in->get_tails().begin(); it != in->get_tails().end(); ++it){
+			timed_tail tail = (*it).second;
+			if(tail.is_marked() && tail.has_next_tail())
+				in->to->mark(in->to->get_interval(tail.next_tail().get_symbol(), tail.next_tail().get_time_value()), tail.next_tail());
+		}
+	}
+	return in->to;
+};
+
+void timed_state::build_targets(){
+	for(int i = first_symbol(); i < MAX_SYMBOL; i = next_symbol(i)){
+		for(interval_it it = get_intervals(i).begin(); it != get_intervals(i).end(); ++it){
+			interval* in = (*it).second;
+			if(in->to == 0 && !in->is_empty()) build_target(in);
+		}
+	}
+};
+
+/* builds the targets of the intervals of this state with more than one tail, they are added to children */
+void timed_state::create_children(vector<timed_state*>& children){
+	for(int i = first_symbol(); i < MAX_SYMBOL; i = next_symbol(i)){
+		for(interval_it it = get_intervals(i).begin(); it != get_intervals(i).end(); ++it){
 			interval* in = (*it).second;
 			assert(in->get_target() == 0);
-			if(!in->is_empty()){
-				in->to = new timed_state();
-				for(const_tail_it it = in->get_tails().begin(); it != in->get_tails().end(); ++it){
-					timed_tail* tail = (*it).second;
-					if(tail->next_tail() != 0) in->to->add_tail(tail->next_tail());
-				}
-				in->to->create_states();
-			}
+			if(in->get_tails().size() > 1) children.push_back(build_target(in));
 		}
-	}	
-}
+	}
+};
+
+/* the minimum number of states in a level of a prefix tree to build the next level on several threads */
+const unsigned int MIN_PARALLEL_LEVEL = 64;
+
+/* creates the children of a contiguous range of the states of a level, chunk by chunk */
+struct level_task{
+	vector<timed_state*>& level;
+	vector< vector<timed_state*> >& children;
+	level_task(vector<timed_state*>& l, vector< vector<timed_state*> >& c) : level(l), children(c) {};
+
+	void operator()(int chunk){
+		int num_chunks = children.size();
+		int first = ((long long)level.size() * chunk) / num_chunks;
+		int last = ((long long)level.size() * (chunk + 1)) / num_chunks;
+		for(int i = first; i < last; ++i) level[i]->create_children(children[chunk]);
+	};
+};
+
+/* builds the prefix tree below this state one level at a time, so the depth of the tree (the length of the
+ * longest string) does not use stack, the subtrees of the states of a large level are built by several threads */
+void timed_state::create_states(){
+	vector<timed_state*> level(1, this);
+	while(!level.empty()){
+		int num_chunks = 1;
+		if(level.size() >= MIN_PARALLEL_LEVEL){
+			num_chunks = 4 * NUM_THREADS;
+			if(num_chunks > (int)level.size()) num_chunks = level.size();
+		}
+		vector< vector<timed_state*> > children(num_chunks);
+		level_task task(level, children);
+		parallel_for(num_chunks, task);
+		
+		level.clear();
+		for(int chunk = 0; chunk < num_chunks; ++chunk)
+			level.insert(level.end(), children[chunk].begin(), children[chunk].end());
+	}
+};
+
+interval_set& timed_state::add_intervals(int symbol){
+	assert(symbol >= 0 && symbol < MAX_SYMBOL);
+	interval_set* intervals = new interval_set();
+	targets.insert(targets.begin() + find_symbol(symbol), pair<int, interval_set*>(symbol, intervals));
+	symbol_mask |= 1ULL << (symbol & 63);
+	return *intervals;
+};
 
 timed_state::~timed_state(){
-	for(int i = 0; i < MAX_SYMBOL; ++i)
-		delete_interval_set(targets[i]);
-	delete[] targets;
+	for(unsigned int i = 0; i < targets.size(); ++i)
+		delete targets[i].second;
 
 	delete stat;
 };
 
-void timed_state::add_tail(timed_tail* tail){
-	get_interval_from_set(targets[tail->get_symbol()], tail->get_time_value())->add_tail(tail);
+void timed_state::add_tail(timed_tail tail){
+	get_interval(tail.get_symbol(), tail.get_time_value())->add_tail(tail);
 	stat->add_count(tail);
 };
 
-void timed_state::del_tail(timed_tail* tail){
-   	get_interval_from_set(targets[tail->get_symbol()], tail->get_time_value())->del_tail(tail);
+void timed_state::del_tail(timed_tail tail){
+   	get_interval(tail.get_symbol(), tail.get_time_value())->del_tail(tail);
 	stat->del_count(tail);
 };
 
+/* the items of the traversals of two subtrees together, and of the traversals of a split
+ * (an interval of the new subtree and the state of the old subtree it was split from) */
+typedef pair<timed_state*, timed_state*> state_pair;
+typedef pair<interval*, timed_state*> split_item;
+
+/* adds the tails, counts, and target states of other to this state and deletes other, both should be (parts of)
+ * prefix trees, i.e. have a single interval for every symbol. The subtrees are merged pair by pair, unbuilt
+ * intervals that get more than one tail are built as in create_states. */
+void timed_state::merge_tree(timed_state* other){
+	traversal<state_pair>::run(state_pair(this, other), [](const state_pair& trees){
+		timed_state* state = trees.first;
+		timed_state* other = trees.second;
+		state->stat->add_counts(other->stat);
+		for(int i = other->first_symbol(); i < MAX_SYMBOL; i = other->next_symbol(i)){
+			assert(other->get_intervals(i).size() == 1);
+			interval* other_in = other->get_interval(i, MAX_TIME);
+			if(other_in->is_empty()) continue;
+			interval* in = state->get_interval(i, MAX_TIME);
+			if(in->is_empty()) in->to = other_in->to;
+			else if(in->to != 0 || other_in->to != 0){
+				if(in->to == 0) build_target(in);
+				if(other_in->to == 0) build_target(other_in);
+				traversal<state_pair>::push(state_pair(in->to, other_in->to));
+			}
+			in->add_tails(other_in);
+			other_in->to = 0;
+			if(in->to == 0 && !LAZY_TREE && in->get_tails().size() > 1) build_target(in)->create_states();
+		}
+		delete other;
+	});
+};
+
 void timed_state::pre_split(timed_state* old_target, timed_state* new_target){
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		if((*old_target->get_intervals(i).begin()).first != MAX_TIME){
-			cerr << (*old_target->get_intervals(i).begin()).first << endl;
-			cerr << (*new_target->get_intervals(i).begin()).first << endl;
-			cerr << (*old_target->get_intervals(i).begin()).second->is_empty() << endl;
-			cerr << (*new_target->get_intervals(i).begin()).second->is_empty() << endl;
-			cerr << (*old_target->get_intervals(i).begin()).second->get_target() << endl;
-			cerr << (*new_target->get_intervals(i).begin()).second->get_target() << endl;
-			assert(0);
-		}
-		for(interval_it it = new_target->get_intervals(i).begin(); it != new_target->get_intervals(i).end(); ++it){
-			interval* new_in = (*it).second;
-			if(new_in->get_end() != MAX_TIME)
-				old_target->split(i, new_in->get_end());
+	traversal<state_pair>::run(state_pair(old_target, new_target), [](const state_pair& targets){
+		timed_state* old_target = targets.first;
+		timed_state* new_target = targets.second;
+		for(int i = old_target->first_symbol(); i < MAX_SYMBOL; i = old_target->next_symbol(i)){
+			if((*old_target->get_intervals(i).begin()).first != MAX_TIME){
+				cerr << (*old_target->get_intervals(i).begin()).first << endl;
+				cerr << (*new_target->find_intervals(i).begin()).first << endl;
+				cerr << (*old_target->get_intervals(i).begin()).second->is_empty() << endl;
+				cerr << (*new_target->find_intervals(i).begin()).second->is_empty() << endl;
+				cerr << (*old_target->get_intervals(i).begin()).second->get_target() << endl;
+				cerr << (*new_target->find_intervals(i).begin()).second->get_target() << endl;
+				assert(0);
+			}
 		}
-	}
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		interval_it it1 = old_target->get_intervals(i).begin();
-		interval_it it2 = new_target->get_intervals(i).begin();
-		while(it1 != old_target->get_intervals(i).end()){
-			interval* old_in = (*it1).second;
-			interval* new_in = (*it2).second;
-			assert(old_in->get_end() == new_in->get_end());
-			assert(old_in->get_begin() == new_in->get_begin());
-			if(old_in->to != 0 && new_in->to != 0) pre_split(old_in->to, new_in->to);
-			++it1;
-			++it2;
+		/* symbols unused by the new target have a single interval, they need no splits */
+		for(int i = new_target->first_symbol(); i < MAX_SYMBOL; i = new_target->next_symbol(i)){
+			for(interval_it it = new_target->get_intervals(i).begin(); it != new_target->get_intervals(i).end(); ++it){
+				interval* new_in = (*it).second;
+				if(new_in->get_end() != MAX_TIME)
+					old_target->split(i, new_in->get_end());
+			}
 		}
-	}
+		for(int i = new_target->first_symbol(); i < MAX_SYMBOL; i = new_target->next_symbol(i)){
+			const_interval_it it1 = old_target->find_intervals(i).begin();
+			interval_it it2 = new_target->get_intervals(i).begin();
+			while(it1 != old_target->find_intervals(i).end()){
+				interval* old_in = (*it1).second;
+				interval* new_in = (*it2).second;
+				assert(old_in->get_end() == new_in->get_end());
+				assert(old_in->get_begin() == new_in->get_begin());
+				if(old_in->to != 0 && new_in->to != 0) traversal<state_pair>::push(state_pair(old_in->to, new_in->to));
+				++it1;
+				++it2;
+			}
+		}
+	});
 };
 
 void timed_state::un_pre_split(timed_state* old_target){
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		interval_it it1 = old_target->get_intervals(i).begin();
-		while(it1 != old_target->get_intervals(i).end()){
-			interval* old_in = (*it1).second;
-			if(old_in->to != 0) un_pre_split(old_in->to);
-			++it1;
+	traversal<timed_state*>::run(old_target, [](timed_state* const& old_target){
+		for(int i = old_target->first_symbol(); i < MAX_SYMBOL; i = old_target->next_symbol(i)){
+			interval_it it1 = old_target->get_intervals(i).begin();
+			while(it1 != old_target->get_intervals(i).end()){
+				interval* old_in = (*it1).second;
+				if(old_in->to != 0) traversal<timed_state*>::push(old_in->to);
+				++it1;
+			}
 		}
-	}
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		interval* old_in = (*old_target->get_intervals(i).begin()).second;
-		while(old_in->get_end() != MAX_TIME){
-			old_target->undo_split(i, old_in->get_end());
-			old_in = (*old_target->get_intervals(i).begin()).second;
+	}, [](timed_state* const& old_target){
+		for(int i = old_target->first_symbol(); i < MAX_SYMBOL; i = old_target->next_symbol(i)){
+			interval* old_in = (*old_target->get_intervals(i).begin()).second;
+			while(old_in->get_end() != MAX_TIME){
+				old_target->undo_split(i, old_in->get_end());
+				old_in = (*old_target->get_intervals(i).begin()).second;
+			}
+			assert((*old_target->get_intervals(i).begin()).first == MAX_TIME);
 		}
-		assert((*old_target->get_intervals(i).begin()).first == MAX_TIME);
-	}			
+	});
 };
 
 void timed_state::recurse_split(interval* new_in, timed_state* old_target){
-	timed_state* new_target = new_in->get_target();
-	for(const_tail_it it = new_in->get_tails().begin(); it != new_in->get_tails().end(); ++it){
-		timed_tail* tail = (*it).second;
-		if(tail->next_tail() != 0){
-			old_target->del_tail(tail->next_tail());
-			new_target->add_tail(tail->next_tail());
+	traversal<split_item>::run(split_item(new_in, old_target), [](const split_item& item){
+		interval* new_in = item.first;
+		timed_state* old_target = item.second;
+		timed_state* new_target = new_in->get_target();
+		for(const_tail_it it = new_in->get_tails().begin(); it != new_in->get_tails().end(); ++it){
+			timed_tail tail = (*it).second;
+			if(tail.has_next_tail()){
+				old_target->del_tail(tail.next_tail());
+				new_target->add_tail(tail.next_tail());
+			}
 		}
-	}
 	
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		interval* next_new_in = new_target->get_interval(i, MAX_TIME);
-		if(!next_new_in->is_empty()){
-			interval* next_old_in = old_target->get_interval(i, MAX_TIME);
-			if(!next_old_in->is_empty()){
-				next_new_in->to = new timed_state();
-				recurse_split(next_new_in, next_old_in->to);
-			} else {
-				next_new_in->to = next_old_in->to;
-				next_old_in->to = 0;
-			}			
+		for(int i = new_target->first_symbol(); i < MAX_SYMBOL; i = new_target->next_symbol(i)){
+			interval* next_new_in = new_target->get_interval(i, MAX_TIME);
+			if(!next_new_in->is_empty()){
+				interval* next_old_in = old_target->get_interval(i, MAX_TIME);
+				if(!next_old_in->is_empty()){
+					if(next_old_in->to == 0) continue;
+					next_new_in->to = new timed_state();
+					traversal<split_item>::push(split_item(next_new_in, next_old_in->to));
+				} else {
+					next_new_in->to = next_old_in->to;
+					next_old_in->to = 0;
+				}			
+			}
 		}
-	}
+	});
 };
 
 void timed_state::recurse_un_split(interval* new_in, timed_state* old_target){
-	timed_state* new_target = new_in->get_target();
-	for(int i = MAX_SYMBOL - 1; i >= 0; --i){
-		interval* next_new_in = new_target->get_interval(i, MAX_TIME);
-		if(!next_new_in->is_empty()){
-			interval* next_old_in = old_target->get_interval(i, MAX_TIME);
-			if(!next_old_in->is_empty()){
-				recurse_un_split(next_new_in, next_old_in->to);
-				delete next_new_in->to;
-			} else {
-				next_old_in->to = next_new_in->to;
-				next_new_in->to = 0;
+	traversal<split_item>::run(split_item(new_in, old_target), [](const split_item& item){
+		timed_state* new_target = item.first->get_target();
+		timed_state* old_target = item.second;
+		for(int i = new_target->last_symbol(); i >= 0; i = new_target->prev_symbol(i)){
+			interval* next_new_in = new_target->get_interval(i, MAX_TIME);
+			if(!next_new_in->is_empty()){
+				interval* next_old_in = old_target->get_interval(i, MAX_TIME);
+				if(!next_old_in->is_empty()){
+					if(next_new_in->to == 0 && next_old_in->to == 0) continue;
+					if(next_new_in->to == 0) build_target(next_new_in);
+					if(next_old_in->to == 0) build_target(next_old_in);
+					traversal<split_item>::push(split_item(next_new_in, next_old_in->to));
+				} else {
+					next_old_in->to = next_new_in->to;
+					next_new_in->to = 0;
+				}
 			}
 		}
-	}
-	
-	for(int i = MAX_SYMBOL - 1; i >= 0; --i){
-		interval* next_new_in = new_target->get_interval(i, MAX_TIME);
-		interval* next_old_in = old_target->get_interval(i, MAX_TIME);
+	}, [](const split_item& item){
+		timed_state* new_target = item.first->get_target();
+		timed_state* old_target = item.second;
+		for(int i = new_target->last_symbol(); i >= 0; i = new_target->prev_symbol(i)){
+			interval* next_new_in = new_target->get_interval(i, MAX_TIME);
+			if(!next_new_in->is_empty() && next_new_in->to != 0) delete next_new_in->to;
+		}
 		
-		next_old_in->tails.insert(next_new_in->tails.begin(), next_new_in->tails.end());
-		for(tail_it it3 = next_new_in->tails.begin(); it3 != next_new_in->tails.end(); ++it3){
-			old_target->stat->add_count((*it3).second);
-			new_target->stat->del_count((*it3).second);
+		for(int i = new_target->last_symbol(); i >= 0; i = new_target->prev_symbol(i)){
+			interval* next_new_in = new_target->get_interval(i, MAX_TIME);
+			interval* next_old_in = old_target->get_interval(i, MAX_TIME);
+			
+			next_old_in->add_tails(next_new_in);
+			for(tail_it it3 = next_new_in->tails.begin(); it3 != next_new_in->tails.end(); ++it3){
+				old_target->stat->add_count((*it3).second);
+				new_target->stat->del_count((*it3).second);
+			}
 		}
-	}
+	});
 };
 
 void timed_state::recurse_merge(timed_state* old_target, timed_state* new_target){
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		interval_it it1 = old_target->get_intervals(i).begin();
-		interval_it it2 = new_target->get_intervals(i).begin();
-		while(it1 != old_target->get_intervals(i).end()){
-			interval* old_in = (*it1).second;
-			interval* new_in = (*it2).second;
-			assert(old_in->get_end() == new_in->get_end());
-			assert(old_in->get_begin() == new_in->get_begin());
+	traversal<state_pair>::run(state_pair(old_target, new_target), [this](const state_pair& targets){
+		timed_state* old_target = targets.first;
+		timed_state* new_target = targets.second;
+		for(int i = old_target->first_symbol(); i < MAX_SYMBOL; i = old_target->next_symbol(i)){
+			interval_it it1 = old_target->get_intervals(i).begin();
+			interval_it it2 = new_target->get_intervals(i).begin();
+			while(it1 != old_target->get_intervals(i).end()){
+				interval* old_in = (*it1).second;
+				interval* new_in = (*it2).second;
+				assert(old_in->get_end() == new_in->get_end());
+				assert(old_in->get_begin() == new_in->get_begin());
 			
-			if(!old_in->is_empty()){
-				if(!new_in->is_empty()){
-					recurse_merge(old_in->to, new_in->to);
-				} else {
-					new_in->to = old_in->to;
-					old_in->to = 0;
-				}
-				new_in->tails.insert(old_in->tails.begin(), old_in->tails.end());
-				for(tail_it it3 = old_in->tails.begin(); it3 != old_in->tails.end(); ++it3){
-					new_target->stat->add_count((*it3).second);
+				if(!old_in->is_empty()){
+					if(!new_in->is_empty()){
+						/* two unbuilt intervals are merged by merging their tails */
+						if(old_in->to != 0 || new_in->to != 0){
+							if(new_in->to == 0) build_target(new_in);
+							if(old_in->to == 0){
+								build_target(old_in);
+								pre_split(old_in->to, new_in->to);
+							}
+							traversal<state_pair>::push(state_pair(old_in->to, new_in->to));
+						}
+					} else {
+						if(old_in->to == 0) build_target(old_in);
+						new_in->to = old_in->to;
+						old_in->to = 0;
+					}
+					new_in->add_tails(old_in);
+					for(tail_it it3 = old_in->tails.begin(); it3 != old_in->tails.end(); ++it3){
+						new_target->stat->add_count((*it3).second);
+					}
 				}
+				++it1;
+				++it2;
 			}
-			++it1;
-			++it2;
 		}
-	}
+	});
 };
 
 void timed_state::recurse_un_merge(timed_state* old_target, timed_state* new_target){
-	for(int i = MAX_SYMBOL - 1; i >= 0; --i){
-		interval_rit it1 = old_target->get_intervals(i).rbegin();
-		interval_rit it2 = new_target->get_intervals(i).rbegin();
-		while(it1 != old_target->get_intervals(i).rend()){
-			interval* old_in = (*it1).second;
-			interval* new_in = (*it2).second;
-			assert(old_in->get_end() == new_in->get_end());
-			assert(old_in->get_begin() == new_in->get_begin());
+	traversal<state_pair>::run(state_pair(old_target, new_target), [this](const state_pair& targets){
+		timed_state* old_target = targets.first;
+		timed_state* new_target = targets.second;
+		for(int i = old_target->last_symbol(); i >= 0; i = old_target->prev_symbol(i)){
+			interval_rit it1 = old_target->get_intervals(i).rbegin();
+			interval_rit it2 = new_target->get_intervals(i).rbegin();
+			while(it1 != old_target->get_intervals(i).rend()){
+				interval* old_in = (*it1).second;
+				interval* new_in = (*it2).second;
+				assert(old_in->get_end() == new_in->get_end());
+				assert(old_in->get_begin() == new_in->get_begin());
 			
-			if(!old_in->is_empty()){
-				for(tail_it it3 = old_in->tails.begin(); it3 != old_in->tails.end(); ++it3){
-					new_in->del_tail((*it3).second);
-					new_target->stat->del_count((*it3).second);
-				}
-				if(!new_in->is_empty()){
-					recurse_un_merge(old_in->to, new_in->to);
-				} else {
-					old_in->to = new_in->to;
-					new_in->to = 0;
+				if(!old_in->is_empty()){
+					new_in->del_tails(old_in);
+					for(tail_it it3 = old_in->tails.begin(); it3 != old_in->tails.end(); ++it3){
+						new_target->stat->del_count((*it3).second);
+					}
+					if(!new_in->is_empty()){
+						/* the merged target can have been built after the merge */
+						if(old_in->to != 0 || new_in->to != 0){
+							assert(new_in->to != 0);
+							if(old_in->to == 0){
+								build_target(old_in);
+								pre_split(old_in->to, new_in->to);
+							}
+							traversal<state_pair>::push(state_pair(old_in->to, new_in->to));
+						}
+					} else {
+						old_in->to = new_in->to;
+						new_in->to = 0;
+					}
 				}
+				++it1;
+				++it2;
 			}
-			++it1;
-			++it2;
 		}
-	}
+	});
 /*
 	for(int i = 0; i < MAX_SYMBOL; ++i){
 		interval_it it1 = old_target->get_intervals(i).begin();
@@ -572,10 +855,10 @@ void timed_state::recurse_un_merge(timed_state* old_target, timed_state* new_tar
 				if(!new_in->is_empty()){
 					old_in->to = new timed_state(new_in->to);
 					for(const_tail_it it = old_in->get_tails().begin(); it != old_in->get_tails().end(); ++it){
-						timed_tail* tail = (*it).second;
-						if(tail->next_tail() != 0){
-							new_in->to->del_tail(tail->next_tail());
-							old_in->to->add_tail(tail->next_tail());
+						timed_tail tail = (*it).second;
+						if(tail.has_next_tail()){
+							new_in->to->del_tail(tail.next_tail());
+							old_in->to->add_tail(tail.next_tail());
 						}
 					}
 					recurse_un_merge(old_in->to, new_in->to);
@@ -591,14 +874,15 @@ void timed_state::recurse_un_merge(timed_state* old_target, timed_state* new_tar
 	}*/
 };
 
-void timed_state::split(int symbol, int time){
+void timed_state::split(int symbol, rti_time time){
 	interval* in = get_interval(symbol, time);
-	split_set(targets[symbol], time);
+	split_set(get_intervals(symbol), time);
 	interval* new_in = get_interval(symbol, time);
 	assert(new_in != in && new_in->get_target() == 0);
 	
 	if(!new_in->is_empty()){
 		if(!in->is_empty()){
+			if(in->to == 0) return;
 			new_in->to = new timed_state();
 			recurse_split(new_in, in->get_target());
 		} else {
@@ -608,23 +892,27 @@ void timed_state::split(int symbol, int time){
 	}		
 };
 
-void timed_state::undo_split(int symbol, int time){
+void timed_state::undo_split(int symbol, rti_time time){
 	interval* in = get_interval(symbol, time + 1);
 	interval* new_in = get_interval(symbol, time);
 	
 	if(!new_in->is_empty()){
 		if(!in->is_empty()){
-			recurse_un_split(new_in, in->get_target());
-			delete new_in->to;
+			if(new_in->to != 0 || in->to != 0){
+				if(new_in->to == 0) build_target(new_in);
+				if(in->to == 0) build_target(in);
+				recurse_un_split(new_in, in->get_target());
+				delete new_in->to;
+			}
 		} else {
 			in->to = new_in->to;
 			new_in->to = 0;
 		}
 	}
-	undo_split_set(targets[symbol], time);
+	undo_split_set(get_intervals(symbol), time);
 };
 
-void timed_state::point(int symbol, int time, timed_state* new_target){
+void timed_state::point(int symbol, rti_time time, timed_state* new_target){
 	interval* in = get_interval(symbol, time);
 	in->undo_tails = tail_set(in->tails);
 	timed_state* old_target = in->get_target();
@@ -637,16 +925,16 @@ void timed_state::point(int symbol, int time, timed_state* new_target){
 	}
 };
 
-void timed_state::undo_point(int symbol, int time, timed_state* new_target){
+void timed_state::undo_point(int symbol, rti_time time, timed_state* new_target){
 	interval* in = get_interval(symbol, time);
 	assert(in->to == new_target);
 	timed_state* old_target = in->undo_to;
 	in->undo_to = 0;
 /*	for(const_tail_it it = in->undo_tails.begin(); it != in->undo_tails.end(); ++it){
-		timed_tail* tail = (*it).second;
-		if(tail->next_tail() != 0){
-			new_target->del_tail(tail->next_tail());
-			old_target->add_tail(tail->next_tail());
+		timed_tail tail = (*it).second;
+		if(tail.has_next_tail()){
+			new_target->del_tail(tail.next_tail());
+			old_target->add_tail(tail.next_tail());
 		}
 	}*/
 	if(old_target != 0){
@@ -656,56 +944,289 @@ void timed_state::undo_point(int symbol, int time, timed_state* new_target){
 	}
 };
 
-void timed_state::recurse_test_merge(timed_state* old_target, timed_state* new_target){
-	if(old_target == 0 || new_target == 0) return;
+/* A side of a merge test that is evaluated without changing the subtrees: a state, or the tails of a state that
+ * is not there (a part of the old subtree that pre_split would split off, or the target of an unbuilt interval).
+ * These tails are a range of VIRTUAL_TAILS, ordered by symbol and time. */
+struct virtual_side{
+	timed_state* state;
+	unsigned int begin;
+	unsigned int end;
+	virtual_side() : state(0), begin(0), end(0) {};
+	explicit virtual_side(timed_state* s) : state(s), begin(0), end(0) {};
+	virtual_side(unsigned int b, unsigned int e) : state(0), begin(b), end(e) {};
+};
 
-	if(TEST_TYPE == 2) {
-		calculate_chi2_score(old_target, new_target);
-		calculate_chi2_score_time(old_target, new_target);
-	} else {
-		get_likelihood_ratio(old_target, new_target);
-		get_likelihood_ratio_time(old_target, new_target);
-	}
-	
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		interval_it it_1 = old_target->get_intervals(i).begin();
-		interval_it it_2 = new_target->get_intervals(i).begin();
-		while(it_1 != old_target->get_intervals(i).end()){
-			interval* old_in = (*it_1).second;
-			interval* new_in = (*it_2).second;
-			++it_1;
-			++it_2;
+typedef pair<virtual_side, virtual_side> virtual_pair;
 
-			if(old_in->get_tails().size() < MIN_DATA || new_in->get_tails().size() < MIN_DATA) continue;
+static thread_local vector<timed_tail> VIRTUAL_TAILS;
+/* the size of VIRTUAL_TAILS when a pair was entered, the tails added after it are dropped when it is left */
+static thread_local vector<unsigned int> VIRTUAL_SIZES;
 
-			recurse_test_merge(old_in->to, new_in->to);
-		}
+static inline bool tail_order(const timed_tail& a, const timed_tail& b){
+	if(a.get_symbol() != b.get_symbol()) return a.get_symbol() < b.get_symbol();
+	return a.get_time_value() < b.get_time_value();
+};
+
+static inline bool symbol_below(const timed_tail& tail, int symbol){
+	return tail.get_symbol() < symbol;
+};
+
+static inline bool symbol_above(int symbol, const timed_tail& tail){
+	return symbol < tail.get_symbol();
+};
+
+static rti_count range_size(unsigned int begin, unsigned int end){
+	rti_count result = 0;
+	for(unsigned int i = begin; i < end; ++i) result += VIRTUAL_TAILS[i].get_count();
+	return result;
+};
+
+/* the side of the next tails of the tails in [begin, end) */
+static virtual_side next_side(unsigned int begin, unsigned int end){
+	unsigned int first = VIRTUAL_TAILS.size();
+	for(unsigned int i = begin; i < end; ++i){
+		timed_tail tail = VIRTUAL_TAILS[i];
+		if(tail.has_next_tail()) VIRTUAL_TAILS.push_back(tail.next_tail());
 	}
+	sort(VIRTUAL_TAILS.begin() + first, VIRTUAL_TAILS.end(), tail_order);
+	return virtual_side(first, VIRTUAL_TAILS.size());
 };
 
-void timed_state::recurse_test_split(timed_state* state){
-	if(state == 0) return;
+/* the side of the target of in, which is target when it is built */
+static virtual_side target_side(interval* in, timed_state* target){
+	if(target != 0) return virtual_side(target);
+	unsigned int first = VIRTUAL_TAILS.size();
+	in->get_tails().for_each([](timed_tail tail){
+		if(tail.has_next_tail()) VIRTUAL_TAILS.push_back(tail.next_tail());
+	});
+	sort(VIRTUAL_TAILS.begin() + first, VIRTUAL_TAILS.end(), tail_order);
+	return virtual_side(first, VIRTUAL_TAILS.size());
+};
+
+/* the statistics of a side, those of a range of tails are counted in scratch and removed by clear_side_statistics */
+static state_statistics* side_statistics(const virtual_side& side, state_statistics* scratch){
+	if(side.state != 0) return side.state->stat;
+	for(unsigned int i = side.begin; i < side.end; ++i) scratch->add_count(VIRTUAL_TAILS[i]);
+	return scratch;
+};
+
+static void clear_side_statistics(const virtual_side& side, state_statistics* scratch){
+	if(side.state != 0) return;
+	for(unsigned int i = side.begin; i < side.end; ++i) scratch->del_count(VIRTUAL_TAILS[i]);
+};
+
+static rti_count side_size(const virtual_side& side){
+	if(side.state != 0) return side.state->stat->get_total_counts();
+	return range_size(side.begin, side.end);
+};
+
+/* the side in VIRTUAL_TAILS of this thread of a side whose tails are in tails, the buffer of another thread */
+static virtual_side copy_side(const virtual_side& side, const vector<timed_tail>& tails){
+	if(side.state != 0 || &tails == &VIRTUAL_TAILS) return side;
+	unsigned int first = VIRTUAL_TAILS.size();
+	VIRTUAL_TAILS.insert(VIRTUAL_TAILS.end(), tails.begin() + side.begin, tails.begin() + side.end);
+	return virtual_side(first, VIRTUAL_TAILS.size());
+};
+
+/* the minimum number of counts in the first pair or state of a test to test parts of its subtrees on several threads,
+ * a split test wakes the waiting threads of parallel_for and stores its terms, smaller tests are faster on one thread */
+const rti_count MIN_PARALLEL_TEST = 20000;
+
+/* A large test is split into parts: the pairs or states of the test are visited on one thread while they hold at least
+ * fork_size counts, the ones below them with fewer counts are the parts, they are tested on several threads. Their size
+ * only decides how the work is spread, the result is that of the test on one thread. 0 if the test is not split. */
+static rti_count fork_size(rti_count size){
+	if(NUM_THREADS <= 1 || PARALLEL_WORKER || size < MIN_PARALLEL_TEST) return 0;
+	return size / (4 * NUM_THREADS);
+};
+
+/* Tests the parts using test_part, every part on one thread and with its own terms. The terms of the states visited
+ * before are in terms, part i was met after the first positions[i] of them. All terms are added to the test in that order,
+ * the order of the test on one thread, so the sums are the same. */
+template <class T, class F> static void join_test(const vector<T>& parts, const vector<unsigned int>& positions, const vector< pair<double, int> >& terms, F test_part){
+	vector< vector< pair<double, int> > > part_terms(parts.size());
+	auto task = [&](int i){
+		TEST_TERMS = &part_terms[i];
+		test_part(parts[i]);
+		TEST_TERMS = 0;
+	};
+	parallel_for(parts.size(), task);
 	
-	if(TEST_TYPE == 2) {
-		calculate_chi2_score(state);
-		calculate_chi2_score_time(state);
-	} else {
-		get_likelihood_ratio(state);
-		get_likelihood_ratio_time(state);
+	unsigned int done = 0;
+	for(unsigned int i = 0; i < parts.size(); ++i){
+		add_test_terms(terms, done, positions[i]);
+		add_test_terms(part_terms[i], 0, part_terms[i].size());
+		done = positions[i];
 	}
+	add_test_terms(terms, done, terms.size());
+};
+
+/* Tests the merge of the subtrees of old_target and new_target without changing them, in is the interval that points
+ * to old_target and is taken to point to new_target. The pairs of states are visited in the order of recurse_merge,
+ * the intervals of the old subtree are split at the boundaries of those of the new subtree on the fly. The tails
+ * are read with for_each, which does not sort the tail sets, so several tests can run at the same time. A large test
+ * is split into parts (see fork_size), while it is split the tails of VIRTUAL_TAILS are kept for the parts. */
+void timed_state::virtual_test_merge(interval* in, timed_state* old_target, timed_state* new_target){
+	/* the pairs of the tails of a symbol in the old side (in old_in or in [begin, end)) and the intervals of the new side */
+	auto visit_symbol = [&](const virtual_side& new_side, int symbol, interval* old_in, unsigned int begin, unsigned int end){
+		if(new_side.state == 0){
+			unsigned int new_begin = lower_bound(VIRTUAL_TAILS.begin() + new_side.begin, VIRTUAL_TAILS.begin() + new_side.end, symbol, symbol_below) - VIRTUAL_TAILS.begin();
+			unsigned int new_end = upper_bound(VIRTUAL_TAILS.begin() + new_begin, VIRTUAL_TAILS.begin() + new_side.end, symbol, symbol_above) - VIRTUAL_TAILS.begin();
+			rti_count old_size = old_in != 0 ? old_in->get_size() : range_size(begin, end);
+			if(old_size < MIN_DATA || range_size(new_begin, new_end) < MIN_DATA) return;
+			virtual_side old_child = old_in != 0 ? target_side(old_in, old_in->to) : next_side(begin, end);
+			traversal<virtual_pair>::push(virtual_pair(old_child, next_side(new_begin, new_end)));
+			return;
+		}
+		const interval_set& intervals = new_side.state->find_intervals(symbol);
+		if(intervals.size() == 1){
+			interval* new_in = (*intervals.begin()).second;
+			rti_count old_size = old_in != 0 ? old_in->get_size() : range_size(begin, end);
+			if(old_size < MIN_DATA || new_in->get_size() < MIN_DATA) return;
+			virtual_side old_child = old_in != 0 ? target_side(old_in, old_in->to) : next_side(begin, end);
+			traversal<virtual_pair>::push(virtual_pair(old_child, target_side(new_in, new_in == in ? new_target : new_in->to)));
+			return;
+		}
+		if(old_in != 0){
+			begin = VIRTUAL_TAILS.size();
+			old_in->get_tails().for_each([](timed_tail tail){ VIRTUAL_TAILS.push_back(tail); });
+			end = VIRTUAL_TAILS.size();
+			sort(VIRTUAL_TAILS.begin() + begin, VIRTUAL_TAILS.end(), tail_order);
+		}
+		for(const_interval_it it = intervals.begin(); it != intervals.end(); ++it){
+			interval* new_in = (*it).second;
+			unsigned int split = begin;
+			while(split < end && VIRTUAL_TAILS[split].get_time_value() <= new_in->get_end()) ++split;
+			if(range_size(begin, split) >= MIN_DATA && new_in->get_size() >= MIN_DATA)
+				traversal<virtual_pair>::push(virtual_pair(next_side(begin, split), target_side(new_in, new_in == in ? new_target : new_in->to)));
+			begin = split;
+		}
+	};
 	
-	for(int i = 0; i < MAX_SYMBOL; ++i){
-		for(interval_it it = state->get_intervals(i).begin(); it != state->get_intervals(i).end(); ++it){
-			interval* in = (*it).second;
+	/* tests the pairs from root, the pairs with fewer than fork counts are added to parts when parts is set */
+	auto test_part = [&](const virtual_pair& root, rti_count fork, vector<virtual_pair>* parts, vector<unsigned int>* positions){
+		state_statistics old_scratch;
+		state_statistics new_scratch;
+		
+		traversal<virtual_pair>::run(root, [&](const virtual_pair& sides){
+			const virtual_side& old_side = sides.first;
+			const virtual_side& new_side = sides.second;
+			VIRTUAL_SIZES.push_back(VIRTUAL_TAILS.size());
+			if(parts != 0 && side_size(old_side) + side_size(new_side) < fork){
+				positions->push_back(TEST_TERMS->size());
+				parts->push_back(sides);
+				return;
+			}
 			
-			if(in->get_tails().size() - in->get_num_marked() < MIN_DATA || in->get_num_marked() < MIN_DATA) continue;
+			state_statistics* old_stat = side_statistics(old_side, &old_scratch);
+			state_statistics* new_stat = side_statistics(new_side, &new_scratch);
+			if(TEST_TYPE == 2) {
+				calculate_chi2_score(old_stat, new_stat);
+				calculate_chi2_score_time(old_stat, new_stat);
+			} else {
+				get_likelihood_ratio(old_stat, new_stat);
+				get_likelihood_ratio_time(old_stat, new_stat);
+			}
+			clear_side_statistics(old_side, &old_scratch);
+			clear_side_statistics(new_side, &new_scratch);
 			
-			recurse_test_split(in->to);
-		}
+			if(old_side.state != 0){
+				timed_state* old_state = old_side.state;
+				for(int i = old_state->first_symbol(); i < MAX_SYMBOL; i = old_state->next_symbol(i)){
+					assert(old_state->find_intervals(i).size() == 1);
+					visit_symbol(new_side, i, (*old_state->find_intervals(i).begin()).second, 0, 0);
+				}
+			} else {
+				unsigned int begin = old_side.begin;
+				while(begin < old_side.end){
+					int symbol = VIRTUAL_TAILS[begin].get_symbol();
+					unsigned int end = begin;
+					while(end < old_side.end && VIRTUAL_TAILS[end].get_symbol() == symbol) ++end;
+					visit_symbol(new_side, symbol, 0, begin, end);
+					begin = end;
+				}
+			}
+		}, [&](const virtual_pair&){
+			if(parts == 0) VIRTUAL_TAILS.resize(VIRTUAL_SIZES.back());
+			VIRTUAL_SIZES.pop_back();
+		});
+	};
+	
+	virtual_pair root = virtual_pair(virtual_side(old_target), virtual_side(new_target));
+	rti_count fork = fork_size(old_target->stat->get_total_counts() + new_target->stat->get_total_counts());
+	if(fork == 0){
+		test_part(root, 0, 0, 0);
+		return;
 	}
+	
+	unsigned int base = VIRTUAL_TAILS.size();
+	vector<virtual_pair> parts;
+	vector<unsigned int> positions;
+	vector< pair<double, int> > terms;
+	TEST_TERMS = &terms;
+	test_part(root, fork, &parts, &positions);
+	TEST_TERMS = 0;
+	
+	const vector<timed_tail>& tails = VIRTUAL_TAILS;
+	join_test(parts, positions, terms, [&](const virtual_pair& part){
+		test_part(virtual_pair(copy_side(part.first, tails), copy_side(part.second, tails)), 0, 0, 0);
+	});
+	VIRTUAL_TAILS.resize(base);
 };
 
-double timed_state::test_point(int symbol, int time, timed_state* new_target){
+/* A large test is split into parts as in virtual_test_merge, the parts build the unbuilt targets in their own subtrees. */
+void timed_state::recurse_test_split(timed_state* state){
+	/* tests the states from root, the states with fewer than fork counts and marks are added to parts when parts is set */
+	auto test_part = [](timed_state* root, rti_count fork, vector<timed_state*>* parts, vector<unsigned int>* positions){
+		traversal<timed_state*>::run(root, [&](timed_state* const& state){
+			if(state == 0) return;
+			if(parts != 0 && state->stat->get_total_counts() + state->stat->get_total_marks() < fork){
+				positions->push_back(TEST_TERMS->size());
+				parts->push_back(state);
+				return;
+			}
+		
+			if(TEST_TYPE == 2) {
+				calculate_chi2_score(state);
+				calculate_chi2_score_time(state);
+			} else {
+				get_likelihood_ratio(state);
+				get_likelihood_ratio_time(state);
+			}
+		
+			for(int i = state->first_symbol(); i < MAX_SYMBOL; i = state->next_symbol(i)){
+				for(interval_it it = state->get_intervals(i).begin(); it != state->get_intervals(i).end(); ++it){
+					interval* in = (*it).second;
+				
+					if(in->get_size() - in->get_num_marked() < MIN_DATA || in->get_num_marked() < MIN_DATA) continue;
+				
+					if(in->to == 0) build_target(in);
+					traversal<timed_state*>::push(in->to);
+				}
+			}
+		});
+	};
+	
+	if(state == 0) return;
+	rti_count fork = fork_size(state->stat->get_total_counts() + state->stat->get_total_marks());
+	if(fork == 0){
+		test_part(state, 0, 0, 0);
+		return;
+	}
+	
+	vector<timed_state*> parts;
+	vector<unsigned int> positions;
+	vector< pair<double, int> > terms;
+	TEST_TERMS = &terms;
+	test_part(state, fork, &parts, &positions);
+	TEST_TERMS = 0;
+	
+	join_test(parts, positions, terms, [&](timed_state* part){
+		test_part(part, 0, 0, 0);
+	});
+};
+
+double timed_state::test_point(int symbol, rti_time time, timed_state* new_target){
 	timed_state* old_target = get_interval(symbol, time)->get_target();
 	if(old_target == 0) return 0.0;
 	
@@ -714,11 +1235,7 @@ double timed_state::test_point(int symbol, int time, timed_state* new_target){
 	if(TEST_TYPE == 2) initialize_consensus_test();
 	else initialize_likelihood_test();
 	
-	get_interval(symbol, time)->to = new_target;
-	pre_split(old_target, new_target);
-	recurse_test_merge(old_target, new_target);
-	un_pre_split(old_target);
-	get_interval(symbol, time)->to = old_target;
+	virtual_test_merge(get_interval(symbol, time), old_target, new_target);
 
 	double p_value = 0.0;
 	if(TEST_TYPE == 2) p_value = calculate_consensus_test();
@@ -727,22 +1244,30 @@ double timed_state::test_point(int symbol, int time, timed_state* new_target){
 	return p_value;
 };
 
-void timed_state::mark(interval* in, timed_tail* tail){
-	if(tail->is_marked()) return;
-	stat->mark(tail);
-	in->add_marked();
-	tail->mark();
-	if(tail->next_tail() != 0)
-		in->to->mark(in->to->get_interval(tail->next_tail()->get_symbol(), tail->next_tail()->get_time_value()), tail->next_tail());
+void timed_state::mark(interval* in, timed_tail tail){
+	timed_state* state = this;
+	while(!tail.is_marked()){
+		state->stat->mark(tail);
+		in->add_marked(tail);
+		tail.mark();
+		if(!tail.has_next_tail() || in->to == 0) return;
+		state = in->to;
+		tail = tail.next_tail();
+		in = state->get_interval(tail.get_symbol(), tail.get_time_value());
+	}
 };
 
-void timed_state::un_mark(interval* in, timed_tail* tail){
-	if(!tail->is_marked()) return;
-	stat->unmark(tail);
-	in->del_marked();
-	tail->un_mark();
-	if(tail->next_tail() != 0)
-		in->to->un_mark(in->to->get_interval(tail->next_tail()->get_symbol(), tail->next_tail()->get_time_value()), tail->next_tail());
+void timed_state::un_mark(interval* in, timed_tail tail){
+	timed_state* state = this;
+	while(tail.is_marked()){
+		state->stat->unmark(tail);
+		in->del_marked(tail);
+		tail.un_mark();
+		if(!tail.has_next_tail() || in->to == 0) return;
+		state = in->to;
+		tail = tail.next_tail();
+		in = state->get_interval(tail.get_symbol(), tail.get_time_value());
+	}
 };
 
 void timed_state::clear_marked(interval* in){
@@ -750,7 +1275,7 @@ void timed_state::clear_marked(interval* in){
 		un_mark(in, (*it).second);
 };
 
-double timed_state::test_split(int symbol, int time){
+double timed_state::test_split(int symbol, rti_time time){
 	if(TEST_TYPE == 2) initialize_consensus_test();
 	else initialize_likelihood_test();
 
@@ -758,10 +1283,10 @@ double timed_state::test_split(int symbol, int time){
 	timed_state* target = in->get_target();
 	if(target == 0) return 0.0;
 	for(const_tail_it it = in->get_tails().begin(); it != in->get_tails().end(); ++it){
-		if((*it).second->get_time_value() <= time)
+		if((*it).second.get_time_value() <= time)
 			mark(in, (*it).second);
 		else
-			assert(!(*it).second->is_marked());
+			assert(!(*it).second.is_marked());
 	}
 
 	recurse_test_split(target);
@@ -33,6 +33,12 @@ using namespace std;
 extern double MAX_DIST;
 extern int MIN_DATA;
 extern int TEST_TYPE;
+/* when set, the prefix tree is not built when the automaton is created, the states below the root's children
+ * are only built when a split, merge or test descends into them */
+extern bool LAZY_TREE;
+/* when set, the strings are split into up to NUM_THREADS shards, the prefix trees of the shards are built on
+ * their own threads and merged pairwise (merge_tree), otherwise the prefix tree is built level by level */
+extern bool SHARDED_TREE;
 
 class timed_automaton;
 class timed_state;
@@ -40,13 +46,20 @@ class timed_state;
 typedef vector<timed_state*> state_list;
 typedef state_list::iterator state_it;
 
+/* the objects in use and allocated in the pools of states, intervals and statistics */
+string pool_usage();
+
 class timed_automaton{
 private:
 	state_list states;
 	timed_state* root;
 	timed_input* input;
+	/* TAIL_WORDS, TAIL_FLAGS and TAIL_SLOTS of the tails of the input */
+	int* tail_words;
+	char* tail_flags;
+	unsigned int* tail_slots;
 	
-	void check_next_tail(interval* in, timed_tail* tail);
+	void check_next_tail(interval* in, timed_tail tail);
 	void recursive_tree_automaton(timed_state*, timed_state*);
 	int recursive_total_num_states(timed_state*);
 
@@ -73,29 +86,10 @@ public:
 		return states;
 	};
 	
-	inline void add_state(timed_state* s){
-		states.push_back(s);
-	};
-
-	inline void del_state(timed_state* s){
-		state_list::iterator it = states.end();
-		while(it != states.begin()){
-			--it;
-			if((*it) == s){
-				states.erase(it);
-				break;
-			}
-		}
-	};
-	
-	inline bool contains_state(timed_state* s){
-		state_list::iterator it = states.begin();
-		while(it != states.end()){
-			if(*it == s) return true;
-			++it;
-		}
-		return false;
-	};
+	/* the states are numbered by their index in states, see timed_state::number */
+	inline void add_state(timed_state* s);
+	inline void del_state(timed_state* s);
+	inline bool contains_state(timed_state* s);
 	
 	inline timed_state* get_state(int number){
 		if(number < states.size())
@@ -103,25 +97,18 @@ public:
 		return 0;
 	};
 	
-	inline int get_number(timed_state* state){
-		int i = 0;
-		for(state_list::const_iterator it = states.begin(); it != states.end();	++it){
-			if(*it == state) return i;
-			i++;
-		}
-		return -1;
-	};
+	inline int get_number(timed_state* state);
 	
 	inline int num_states(){
 		return states.size();
 	};
 	
-	inline char get_alph_char(int i){
+	inline const string& get_alph_name(int i){
 		return input->get_symbol(i);
 	};
 
-	inline char get_alph_int(char c){
-		return input->get_int(c);
+	inline int get_alph_int(const string& name){
+		return input->get_int(name);
 	};
 	
 	inline const timed_input* get_input(){
@@ -129,9 +116,39 @@ public:
 	};
 };
 
+/* the interval set of the symbols a state has not used, a single interval [MIN_TIME, MAX_TIME]
+ * without tails or target, reset by the timed_automaton constructors */
+extern interval_set EMPTY_INTERVALS;
+
+/* A non-empty interval without a target is unbuilt, its target is the prefix tree of the next tails of its tails.
+ * It is built (by build_target) when a split, merge or test descends into the interval. An interval with a single
+ * tail is left unbuilt when the prefix tree is created, so the chain of states below it, one for every remaining
+ * symbol of a string, is only stored when it is needed. */
 class timed_state{
 private:
-	interval_set* targets;
+	/* the interval sets of the symbols that have been used, ordered by symbol, the other
+	 * symbols are not stored and have the intervals of EMPTY_INTERVALS */
+	vector< pair<int, interval_set*> > targets;
+	/* bit (symbol % 64) is set when a symbol with that remainder is used, a quick test for unused symbols */
+	unsigned long long symbol_mask;
+	
+	/* the index in targets of the first symbol that is at least symbol,
+	 * states that use all symbols up to symbol have it at index symbol */
+	inline unsigned int find_symbol(int symbol) const{
+		if((unsigned int)symbol < targets.size() && targets[symbol].first == symbol) return symbol;
+		unsigned int low = 0;
+		unsigned int high = targets.size();
+		while(low < high){
+			unsigned int middle = (low + high) / 2;
+			if(targets[middle].first < symbol) low = middle + 1;
+			else high = middle;
+		}
+		return low;
+	};
+	
+	interval_set& add_intervals(int symbol);
+	void create_children(vector<timed_state*>& children);
+	static timed_state* build_target(interval* in);
 	
 	inline void pre_split(timed_state* old_target, timed_state* new_target);
 	inline void un_pre_split(timed_state* old_target);
@@ -139,58 +156,136 @@ private:
 	inline void recurse_un_merge(timed_state* old_target, timed_state* new_target);
 	inline void recurse_split(interval* new_in, timed_state* old_target);
 	inline void recurse_un_split(interval* new_in, timed_state* old_target);
-	inline void recurse_test_merge(timed_state* old_target, timed_state* new_target);
+	static void virtual_test_merge(interval* in, timed_state* old_target, timed_state* new_target);
 	inline void recurse_test_split(timed_state* state);
 	
 	friend class timed_automaton;
 	friend class state_statistics;
-	friend double calculate_chi2_score(timed_state* old_target, timed_state* new_target);
+	friend struct level_task;
 	friend double calculate_chi2_score(timed_state* target);
-	friend double calculate_chi2_score_time(timed_state* old_target, timed_state* new_target);
 	friend double calculate_chi2_score_time(timed_state* target);
-	friend pair<int, double> get_likelihood_ratio(timed_state* old_target, timed_state* new_target);
 	friend pair<int, double> get_likelihood_ratio(timed_state* target);
-	friend pair<int, double> get_likelihood_ratio_time(timed_state* old_target, timed_state* new_target);
 	friend pair<int, double> get_likelihood_ratio_time(timed_state* target);
   
 public:
+	/* taken from and returned to a pool, see pool.h */
+	static inline void* operator new(size_t size){
+		assert(size == sizeof(timed_state));
+		return object_pool<timed_state>::allocate();
+	};
+	
+	static inline void operator delete(void* p){
+		object_pool<timed_state>::release(p);
+	};
+	
 	timed_state();
 	timed_state(timed_state* state);    
 	~timed_state();
 	
 	state_statistics* stat;
+	/* the index of the state in the states of its automaton, -1 when it is not one of them */
+	int number;
+	
+	/* builds the targets of the unbuilt intervals of this state, the states of the automaton have no unbuilt intervals */
+	void build_targets();
 
 	void create_states();	
+	void merge_tree(timed_state* other);
 
 	string to_str(timed_automaton*);
 	string to_str_full(timed_automaton*);
 
-    inline timed_state* get_target(int symbol, int time) const{
-    	return get_interval_from_set(targets[symbol], time)->get_target();
+    inline bool has_symbol(int symbol) const{
+    	if((symbol_mask & (1ULL << (symbol & 63))) == 0) return false;
+    	unsigned int index = find_symbol(symbol);
+    	return index < targets.size() && targets[index].first == symbol;
     };
     
-    inline interval_set& get_intervals(const int symbol) const{
-    	return targets[symbol];
+    /* the used symbols in increasing order, MAX_SYMBOL after the last one:
+     * for(int i = first_symbol(); i < MAX_SYMBOL; i = next_symbol(i)) */
+    inline int first_symbol() const{
+    	return targets.empty() ? MAX_SYMBOL : targets[0].first;
     };
     
-    inline interval* get_interval(int symbol, int time) const{
-    	return get_interval_from_set(targets[symbol], time);
+    inline int next_symbol(int symbol) const{
+    	unsigned int index = find_symbol(symbol + 1);
+    	return index < targets.size() ? targets[index].first : MAX_SYMBOL;
     };
     
-    void add_tail(timed_tail* tail);
-    void del_tail(timed_tail* tail);
+    /* the used symbols in decreasing order, -1 after the first one */
+    inline int last_symbol() const{
+    	return targets.empty() ? -1 : targets.back().first;
+    };
+    
+    inline int prev_symbol(int symbol) const{
+    	unsigned int index = find_symbol(symbol);
+    	return index > 0 ? targets[index - 1].first : -1;
+    };
+    
+    inline timed_state* get_target(int symbol, rti_time time) const{
+    	return get_interval_from_set(find_intervals(symbol), time)->get_target();
+    };
+    
+    /* the intervals of symbol, these are created when the symbol was not used yet */
+    inline interval_set& get_intervals(const int symbol){
+    	if(symbol_mask & (1ULL << (symbol & 63))){
+    		unsigned int index = find_symbol(symbol);
+    		if(index < targets.size() && targets[index].first == symbol) return *targets[index].second;
+    	}
+    	return add_intervals(symbol);
+    };
+    
+    /* the intervals of symbol without creating them, EMPTY_INTERVALS (which should not be changed)
+     * when the symbol is not used */
+    inline const interval_set& find_intervals(const int symbol) const{
+    	if((symbol_mask & (1ULL << (symbol & 63))) == 0) return EMPTY_INTERVALS;
+    	unsigned int index = find_symbol(symbol);
+    	if(index < targets.size() && targets[index].first == symbol) return *targets[index].second;
+    	return EMPTY_INTERVALS;
+    };
+    
+    inline interval* get_interval(int symbol, rti_time time){
+    	return get_interval_from_set(get_intervals(symbol), time);
+    };
+    
+    void add_tail(timed_tail tail);
+    void del_tail(timed_tail tail);
 
-    void point(int symbol, int time, timed_state* target);
-    void undo_point(int symbol, int time, timed_state* target);
-    double test_point(int symbol, int time, timed_state* target);
+    void point(int symbol, rti_time time, timed_state* target);
+    void undo_point(int symbol, rti_time time, timed_state* target);
+    double test_point(int symbol, rti_time time, timed_state* target);
     
-    void split(int symbol, int time);
-    void undo_split(int symbol, int time);
-    double test_split(int symbol, int time);
+    void split(int symbol, rti_time time);
+    void undo_split(int symbol, rti_time time);
+    double test_split(int symbol, rti_time time);
     
-	void mark(interval*, timed_tail* tail);
-	void un_mark(interval*, timed_tail* tail);	
+	void mark(interval*, timed_tail tail);
+	void un_mark(interval*, timed_tail tail);	
 	void clear_marked(interval*);
 };
 
+inline void timed_automaton::add_state(timed_state* s){
+	s->build_targets();
+	s->number = states.size();
+	states.push_back(s);
+};
+
+/* the states after s are renumbered, s is usually the last state */
+inline void timed_automaton::del_state(timed_state* s){
+	if(!contains_state(s)) return;
+	states.erase(states.begin() + s->number);
+	for(unsigned int i = s->number; i < states.size(); ++i)
+		states[i]->number = i;
+	s->number = -1;
+};
+
+inline bool timed_automaton::contains_state(timed_state* s){
+	return s != 0 && s->number >= 0 && s->number < (int)states.size() && states[s->number] == s;
+};
+
+inline int timed_automaton::get_number(timed_state* state){
+	if(contains_state(state)) return state->number;
+	return -1;
+};
+
 #endif /* TIMED_AUTOMATON_H_*/
@@ -28,103 +28,904 @@
  */
 
 #include "timed_data.h"
+#include "parallel.h"
 #include <assert.h>
 #include <stdlib.h>
-#include <set>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 int MAX_SYMBOL = 2;
-int MIN_TIME = 0;
-int MAX_TIME = 1000000;
+rti_time MIN_TIME = 0;
+rti_time MAX_TIME = 1000000;
 int NUM_WORDS = 0;
-int TOTAL_NUM_SYMBOLS = 0;
+long long TOTAL_NUM_SYMBOLS = 0;
 
 int NUM_HISTOGRAM_BARS = 4;
-int TIME_IQR25 = 0;
-int TIME_IQR50 = 0;
-int TIME_IQR75 = 0;
+rti_time* TIME_CUT_POINTS = 0;
+rti_time TIME_IQR25 = 0;
+rti_time TIME_IQR50 = 0;
+rti_time TIME_IQR75 = 0;
+
+#ifdef RTI_WIDE
+const rti_time* TIME_VALUES = 0;
+#endif
+
+#ifdef RTI_WIDE
+static const int WIDE_BUILD = 1;
+#else
+static const int WIDE_BUILD = 0;
+#endif
+
+/* smaller files are parsed by a single thread */
+long long MIN_PARALLEL_PARSE_SIZE = 1 << 22;
+
+/* the mapped text parsers stop when the header gives another number of strings than the file holds */
+static const char* STRING_COUNT_ERROR = "the number of strings in the header does not match the number of lines";
+/* and when a length or time value is not an integer or a symbol is missing */
+static const char* TOKEN_ERROR = "malformed input: a length or time value is not an integer or a symbol is missing";
+
+void input_error(const char* message){
+	cerr << message << endl;
+	exit(1);
+};
+
+/* scanner for the mapped file parser, skips whitespace and reads a (positive) integer or a symbol,
+ * returns 0 when there is no symbol or the next token is not an integer */
+static inline bool is_space(char c){
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+};
+
+static inline const char* skip_space(const char* p, const char* end){
+	while(p != end && is_space(*p)) ++p;
+	return p;
+};
+
+static inline const char* scan_symbol(const char* p, const char* end, const char*& name, int& length){
+	p = skip_space(p, end);
+	if(p == end) return 0;
+	name = p;
+	while(p != end && !is_space(*p)) ++p;
+	length = p - name;
+	return p;
+};
+
+template <class T> static inline const char* scan_int(const char* p, const char* end, T& value){
+	p = skip_space(p, end);
+	bool negative = false;
+	if(p != end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		++p;
+	}
+	if(p == end || *p < '0' || *p > '9') return 0;
+	T result = 0;
+	while(p != end && *p >= '0' && *p <= '9'){
+		result = result * 10 + (*p - '0');
+		++p;
+	}
+	if(p != end && !is_space(*p)) return 0;
+	value = negative ? -result : result;
+	return p;
+};
+
+static inline double get_seconds(){
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+};
 
 timed_input::timed_input(istream &str){
-	str >> num_words >> alph_size;
-	set<int> time_points;
+	arena = 0;
+	arena_capacity = 0;
+	mapped_data = 0;
+	mapped_size = 0;
+	read_stream(str);
+	collapse_duplicates();
+};
+
+timed_input::timed_input(const char* file_name){
+	double start_time = get_seconds();
+	arena = 0;
+	arena_capacity = 0;
+	mapped_data = 0;
+	mapped_size = 0;
+	
+	int fd = open(file_name, O_RDONLY);
+	struct stat file_stat;
+	void* data = MAP_FAILED;
+	if(fd != -1 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+		data = mmap(0, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	
+	if(data == MAP_FAILED){
+		if(fd != -1) close(fd);
+		ifstream str(file_name);
+		read_stream(str);
+		collapse_duplicates();
+		return;
+	}
+	close(fd);
+	
+	if(map_binary((const char*)data, file_stat.st_size)){
+		mapped_data = data;
+		mapped_size = file_stat.st_size;
+		cerr << "mapped " << num_words << " strings, " << TOTAL_NUM_SYMBOLS << " symbols in "
+		     << get_seconds() - start_time << "s" << endl;
+		return;
+	}
+	
+	madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+	if(NUM_THREADS > 1 && file_stat.st_size >= MIN_PARALLEL_PARSE_SIZE)
+		parse_buffer_parallel((const char*)data, (const char*)data + file_stat.st_size);
+	else
+		parse_buffer((const char*)data, (const char*)data + file_stat.st_size);
+	munmap(data, file_stat.st_size);
+	
+	double seconds = get_seconds() - start_time;
+	if(seconds <= 0.0) seconds = 1.0e-6;
+	cerr << "parsed " << num_words << " strings, " << TOTAL_NUM_SYMBOLS << " symbols ("
+	     << file_stat.st_size << " bytes) in " << seconds << "s: "
+	     << ((double)file_stat.st_size / (1024.0 * 1024.0)) / seconds << " MB/s, "
+	     << (double)TOTAL_NUM_SYMBOLS / seconds << " symbols/s" << endl;
+	collapse_duplicates();
+};
+
+timed_input::timed_input(const vector<const char*>& file_names){
+	double start_time = get_seconds();
+	arena = 0;
+	arena_capacity = 0;
+	mapped_data = 0;
+	mapped_size = 0;
+	
+	int num_files = file_names.size();
+	vector<void*> mapped(num_files, MAP_FAILED);
+	vector<long long> sizes(num_files, 0);
+	vector<string> buffers(num_files);      // the files that cannot be mapped
+	vector<parse_chunk> chunks;
+	int n = 0;
+	int a = 0;
+	long long total_size = 0;
+	for(int f = 0; f < num_files; ++f){
+		int fd = open(file_names[f], O_RDONLY);
+		struct stat file_stat;
+		if(fd != -1 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+			mapped[f] = mmap(0, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(fd != -1) close(fd);
+		
+		const char* begin;
+		if(mapped[f] != MAP_FAILED){
+			sizes[f] = file_stat.st_size;
+			begin = (const char*)mapped[f];
+			madvise(mapped[f], sizes[f], MADV_SEQUENTIAL);
+		} else {
+			ifstream str(file_names[f]);
+			buffers[f].assign(istreambuf_iterator<char>(str), istreambuf_iterator<char>());
+			sizes[f] = buffers[f].size();
+			begin = buffers[f].data();
+		}
+		const char* end = begin + sizes[f];
+		total_size += sizes[f];
+		if(skip_space(begin, end) == end) continue;
+		if(sizes[f] >= (long long)strlen(TIMED_DATA_MAGIC) && memcmp(begin, TIMED_DATA_MAGIC, strlen(TIMED_DATA_MAGIC)) == 0)
+			input_error((string(file_names[f]) + " is a binary dataset, several files can only be read in the text format").c_str());
+		
+		int file_n, file_a;
+		const char* p = scan_int(begin, end, file_n);
+		if(p != 0) p = scan_int(p, end, file_a);
+		if(p == 0) input_error(TOKEN_ERROR);
+		n += file_n;
+		if(file_a > a) a = file_a;
+		add_chunks(chunks, p, end, sizes[f] >= MIN_PARALLEL_PARSE_SIZE ? NUM_THREADS : 1);
+	}
+	
+	initialize(n, a);
+	parse_chunks(chunks);
+	for(int f = 0; f < num_files; ++f)
+		if(mapped[f] != MAP_FAILED) munmap(mapped[f], sizes[f]);
+	
+	double seconds = get_seconds() - start_time;
+	if(seconds <= 0.0) seconds = 1.0e-6;
+	cerr << "parsed " << num_words << " strings, " << TOTAL_NUM_SYMBOLS << " symbols ("
+	     << total_size << " bytes in " << num_files << " files) in " << seconds << "s: "
+	     << ((double)total_size / (1024.0 * 1024.0)) / seconds << " MB/s, "
+	     << (double)TOTAL_NUM_SYMBOLS / seconds << " symbols/s" << endl;
+	collapse_duplicates();
+};
+
+void timed_input::initialize(int n, int a){
+	num_words = n;
+	alph_size = a;
 	NUM_WORDS = num_words;
 	MAX_SYMBOL = alph_size;
-	int time_sup = -1;
-	alphabet = new char[alph_size];
-	words = new timed_word*[num_words];
-	int current_alphabet_size = 0;
+	words = new timed_word[num_words];
+};
+
+/* grows the arena to hold at least size entries per column, keeping the first used ones */
+void timed_input::reserve_arena(long long size, long long used){
+	if(size <= arena_capacity) return;
+	long long capacity = arena_capacity * 2;
+	if(capacity < size) capacity = size;
+	int* new_arena = (int*)malloc(2 * capacity * sizeof(int));
+	assert(new_arena != 0);
+	if(arena != 0){
+		memcpy(new_arena, arena, used * sizeof(int));
+		memcpy(new_arena + capacity, arena + arena_capacity, used * sizeof(int));
+		free(arena);
+	}
+	arena = new_arena;
+	arena_capacity = capacity;
+};
+
+/* copies the words back to back into an arena of exactly the right size */
+void timed_input::pack_arena(){
+	long long size = 0;
+	for(int line = 0; line < num_words; ++line)
+		size += words[line].length + 1;
+	if(size == arena_capacity) return;
+	
+	int* new_arena = (int*)malloc(2 * size * sizeof(int));
+	assert(new_arena != 0 || size == 0);
+	long long position = 0;
+	for(int line = 0; line < num_words; ++line){
+		timed_word& word = words[line];
+		memcpy(new_arena + position, word.symbols, (word.length + 1) * sizeof(int));
+		memcpy(new_arena + size + position, word.time_values, (word.length + 1) * sizeof(int));
+		word.symbols = new_arena + position;
+		word.time_values = new_arena + size + position;
+		position += word.length + 1;
+	}
+	free(arena);
+	arena = new_arena;
+	arena_capacity = size;
+};
+
+/* the entry of the time column for a time value */
+inline int timed_input::add_time(rti_time value){
+#ifdef RTI_WIDE
+	return time_numbers.insert(value);
+#else
+	return value;
+#endif
+};
+
+/* the entry of the time column at the end of a word */
+static inline int time_sum_entry(rti_time time_sum){
+#ifdef RTI_WIDE
+	return -1;
+#else
+	return time_sum;
+#endif
+};
+
+#ifdef RTI_WIDE
+/* orders time numbers by their time values */
+struct time_number_less{
+	const time_table& times;
+	time_number_less(const time_table& t) : times(t) {};
+	bool operator()(int a, int b) const{ return times.get_value(a) < times.get_value(b); };
+};
+#endif
+
+/* wide build: sorts the distinct time values and replaces their numbers in the time columns by their ranks */
+void timed_input::rank_time_values(){
+#ifdef RTI_WIDE
+	vector<int> order(time_numbers.size());
+	for(int i = 0; i < time_numbers.size(); ++i) order[i] = i;
+	sort(order.begin(), order.end(), time_number_less(time_numbers));
+	
+	vector<int> ranks(time_numbers.size());
+	sorted_time_values.resize(time_numbers.size());
+	for(int rank = 0; rank < (int)order.size(); ++rank){
+		ranks[order[rank]] = rank;
+		sorted_time_values[rank] = time_numbers.get_value(order[rank]);
+	}
+	for(int line = 0; line < num_words; ++line)
+		for(int index = 0; index < words[line].length; ++index)
+			words[line].time_values[index] = ranks[words[line].time_values[index]];
+	TIME_VALUES = sorted_time_values.empty() ? 0 : &sorted_time_values[0];
+	time_numbers = time_table();
+#endif
+};
+
+/* points every word into the columns, word line starts at offsets[line] */
+void timed_input::set_word_columns(int* symbols, int* time_values, const long long* offsets){
+	for(int line = 0; line < num_words; ++line){
+		words[line].length      = (int)(offsets[line + 1] - offsets[line]) - 1;
+		words[line].symbols     = symbols + offsets[line];
+		words[line].time_values = time_values + offsets[line];
+	}
+};
+
+timed_input::timed_input(const symbol_table& names, const vector<int>& lengths, const vector<int>& symbols, const vector<rti_time>& time_values){
+	arena = 0;
+	arena_capacity = 0;
+	mapped_data = 0;
+	mapped_size = 0;
+	initialize(lengths.size(), names.size());
+	
+	reserve_arena(symbols.size() + lengths.size(), 0);
+	time_point_set time_points;
+	vector<long long> offsets(num_words + 1);
+	long long position = 0;
+	long long source = 0;
+	for(int line = 0; line < num_words; ++line){
+		offsets[line] = position;
+		rti_time time_sum = 0;
+		for(int index = 0; index < lengths[line]; ++index, ++source, ++position){
+			const string& name = names.get_name(symbols[source]);
+			arena[position] = add_symbol(name.data(), name.size());
+			arena[arena_capacity + position] = add_time(time_values[source]);
+			time_points.insert(time_values[source]);
+			time_sum += time_values[source];
+		}
+		arena[position] = num_words;
+		arena[arena_capacity + position] = time_sum_entry(time_sum);
+		++position;
+	}
+	offsets[num_words] = position;
+	TOTAL_NUM_SYMBOLS += symbols.size();
+	set_word_columns(arena, arena + arena_capacity, &offsets[0]);
+	rank_time_values();
+	set_time_points(time_points);
+	collapse_duplicates();
+};
+
+/* the alphabet grows when there are more symbols than the header says (every file of a multi-file input has its own) */
+int timed_input::add_symbol(const char* name, int length){
+	int number = alphabet.insert(name, length);
+	if(alphabet.size() > alph_size){
+		alph_size = alphabet.size();
+		MAX_SYMBOL = alph_size;
+	}
+	return number;
+};
+
+void timed_input::read_stream(istream &str){
+	int n, a;
+	str >> n >> a;
+	initialize(n, a);
+	time_point_set time_points;
+	vector<long long> offsets(num_words + 1);
+	long long position = 0;
+	string name;
 	for(int line = 0; line < num_words; ++line)
 	{
-		timed_word* word = new timed_word();
-	    str >> word->length;
-	    word->symbols       = (int*)malloc((word->length + 1)*sizeof(int));
-	    word->char_symbols  = (char*)malloc((word->length + 1)*sizeof(char));
-	    word->time_values   = (int*)malloc((word->length + 1)*sizeof(int));
+		int length;
+	    str >> length;
+	    reserve_arena(position + length + 1, position);
+	    int* symbols = arena + position;
+	    int* time_values = arena + arena_capacity + position;
 	    int index;
-	    int time_sum = 0;
-	    for(index = 0; index < word->length; ++index)
+	    rti_time time_sum = 0;
+	    for(index = 0; index < length; ++index)
 	    {
 			TOTAL_NUM_SYMBOLS++;
-			char c;
-			str >> c;
-			word->char_symbols[index] = c;
-			str >> word->time_values[index];
-			time_points.insert(word->time_values[index]);
-			time_sum += word->time_values[index];
-			bool found = 0;
-			for(unsigned i = 0; i < current_alphabet_size; ++i)
-			{
-				if(alphabet[i] == c)
-				{
-					word->symbols[index] = i;
-					found = 1;
-					break;
-				}
+			rti_time value;
+			str >> name;
+			str >> value;
+			time_points.insert(value);
+			time_sum += value;
+			time_values[index] = add_time(value);
+			symbols[index] = add_symbol(name.data(), name.size());
+	    }
+	    symbols[index] = num_words;
+	    time_values[index] = time_sum_entry(time_sum);
+	    offsets[line] = position;
+	    position += length + 1;
+	}
+	offsets[num_words] = position;
+	set_word_columns(arena, arena + arena_capacity, &offsets[0]);
+	rank_time_values();
+	set_time_points(time_points);
+};
+
+void timed_input::parse_buffer(const char* p, const char* end){
+	int n, a;
+	p = scan_int(p, end, n);
+	if(p != 0) p = scan_int(p, end, a);
+	if(p == 0) input_error(TOKEN_ERROR);
+	initialize(n, a);
+	time_point_set time_points;
+	vector<long long> offsets(num_words + 1);
+	long long position = 0;
+	for(int line = 0; line < num_words; ++line)
+	{
+		if(skip_space(p, end) == end) input_error(STRING_COUNT_ERROR);
+		int word_length;
+		p = scan_int(p, end, word_length);
+		if(p == 0) input_error(TOKEN_ERROR);
+	    reserve_arena(position + word_length + 1, position);
+	    int* symbols = arena + position;
+	    int* time_values = arena + arena_capacity + position;
+	    int index;
+	    rti_time time_sum = 0;
+	    for(index = 0; index < word_length; ++index)
+	    {
+			TOTAL_NUM_SYMBOLS++;
+			const char* name;
+			int length;
+			rti_time value;
+			p = scan_symbol(p, end, name, length);
+			if(p != 0) p = scan_int(p, end, value);
+			if(p == 0) input_error(TOKEN_ERROR);
+			time_points.insert(value);
+			time_sum += value;
+			time_values[index] = add_time(value);
+			symbols[index] = add_symbol(name, length);
+	    }
+	    symbols[index] = num_words;
+	    time_values[index] = time_sum_entry(time_sum);
+	    offsets[line] = position;
+	    position += word_length + 1;
+	}
+	if(skip_space(p, end) != end) input_error(STRING_COUNT_ERROR);
+	offsets[num_words] = position;
+	set_word_columns(arena, arena + arena_capacity, &offsets[0]);
+	rank_time_values();
+	set_time_points(time_points);
+};
+
+/* a part of the file, parsed by one thread into local buffers */
+struct parse_chunk{
+	const char* begin;
+	const char* end;
+	int first_word;
+	long long first_position;     // of the first word in the columns
+	bool malformed;               // the chunk stopped at a malformed token, reported by parse_chunks
+	
+	vector<int>  lengths;
+	vector<int>  symbols;         // numbered in order of first occurrence within the chunk
+	vector<int>  time_values;     // wide: numbered in order of first occurrence within the chunk
+	symbol_table chunk_alphabet;
+	vector<int>  symbol_numbers;  // chunk symbol number -> input symbol number
+	time_point_set time_points;
+#ifdef RTI_WIDE
+	time_table   chunk_times;
+	vector<int>  time_numbers;    // chunk time number -> input time number
+	
+	inline int add_time(rti_time value){ return chunk_times.insert(value); };
+	inline rti_time get_time(int entry) const{ return chunk_times.get_value(entry); };
+	inline int get_time_number(int entry) const{ return time_numbers[entry]; };
+#else
+	inline int add_time(rti_time value){ return value; };
+	inline rti_time get_time(int entry) const{ return entry; };
+	inline int get_time_number(int entry) const{ return entry; };
+#endif
+	
+	void operator()(){
+		const char* p = skip_space(begin, end);
+		while(p != end){
+			int length;
+			p = scan_int(p, end, length);
+			if(p == 0) break;
+			lengths.push_back(length);
+			for(int index = 0; index < length; ++index){
+				const char* name;
+				int name_length;
+				p = scan_symbol(p, end, name, name_length);
+				rti_time time;
+				if(p != 0) p = scan_int(p, end, time);
+				if(p == 0) break;
+				symbols.push_back(chunk_alphabet.insert(name, name_length));
+				time_values.push_back(add_time(time));
+				time_points.insert(time);
 			}
-			if(found == 0)
-			{
-				alphabet[current_alphabet_size] = c;
-				word->symbols[index] = current_alphabet_size;
-				current_alphabet_size++;
-				assert(current_alphabet_size <= MAX_SYMBOL);
+			if(p == 0) break;
+			p = skip_space(p, end);
+		}
+		malformed = (p == 0);
+	};
+};
+
+struct parse_chunk_task{
+	vector<parse_chunk>& chunks;
+	parse_chunk_task(vector<parse_chunk>& c) : chunks(c) {};
+	void operator()(int i){ chunks[i](); };
+};
+
+/* copies a parsed chunk into the columns, using the input symbol numbers */
+struct fill_chunk_task{
+	vector<parse_chunk>& chunks;
+	int* symbols;
+	int* time_values;
+	long long* offsets;
+	int num_words;
+	fill_chunk_task(vector<parse_chunk>& c, int* s, int* t, long long* o, int n) : chunks(c), symbols(s), time_values(t), offsets(o), num_words(n) {};
+	
+	void operator()(int i){
+		parse_chunk& chunk = chunks[i];
+		int position = 0;
+		long long column_position = chunk.first_position;
+		for(int line = 0; line < (int)chunk.lengths.size(); ++line){
+			int length = chunk.lengths[line];
+			offsets[chunk.first_word + line] = column_position;
+			rti_time time_sum = 0;
+			for(int index = 0; index < length; ++index, ++position, ++column_position){
+				symbols[column_position] = chunk.symbol_numbers[chunk.symbols[position]];
+				time_values[column_position] = chunk.get_time_number(chunk.time_values[position]);
+				time_sum += chunk.get_time(chunk.time_values[position]);
 			}
-	    }
-	    word->symbols[index] = num_words;
-	    word->char_symbols[index] = '\0';
-	    word->time_values[index] = time_sum;
-	    words[line] = word;
+			symbols[column_position] = num_words;
+			time_values[column_position] = time_sum_entry(time_sum);
+			++column_position;
+		}
+		vector<int>().swap(chunk.time_values);
+		vector<int>().swap(chunk.symbols);
+	};
+};
+
+/* Every timed string has to be on its own line, the chunks are parsed in parallel
+ * and then the symbols are numbered in order of their first occurrence in the file,
+ * so the result is identical to that of parse_buffer */
+void timed_input::parse_buffer_parallel(const char* p, const char* end){
+	int n, a;
+	p = scan_int(p, end, n);
+	if(p != 0) p = scan_int(p, end, a);
+	if(p == 0) input_error(TOKEN_ERROR);
+	initialize(n, a);
+	
+	vector<parse_chunk> chunks;
+	add_chunks(chunks, p, end, NUM_THREADS);
+	parse_chunks(chunks);
+};
+
+/* splits the strings in [begin, end) into num_chunks chunks */
+void timed_input::add_chunks(vector<parse_chunk>& chunks, const char* begin, const char* end, int num_chunks){
+	vector<const char*> bounds;
+	split_lines(begin, end, num_chunks, bounds);
+	for(int i = 0; i < num_chunks; ++i){
+		chunks.push_back(parse_chunk());
+		chunks.back().begin = bounds[i];
+		chunks.back().end = bounds[i + 1];
+		chunks.back().malformed = false;
+	}
+};
+
+/* parses the chunks in parallel, the words and symbols are numbered in chunk order,
+ * input errors of the chunks are reported here and not on the threads that parse them */
+void timed_input::parse_chunks(vector<parse_chunk>& chunks){
+	int num_chunks = chunks.size();
+	parse_chunk_task parse_task(chunks);
+	parallel_for(num_chunks, parse_task);
+	for(int i = 0; i < num_chunks; ++i)
+		if(chunks[i].malformed) input_error(TOKEN_ERROR);
+	
+	time_point_set time_points;
+	int line = 0;
+	long long position = 0;
+	for(int i = 0; i < num_chunks; ++i){
+		parse_chunk& chunk = chunks[i];
+		chunk.first_word = line;
+		chunk.first_position = position;
+		line += chunk.lengths.size();
+		position += chunk.time_values.size() + chunk.lengths.size();
+		TOTAL_NUM_SYMBOLS += chunk.time_values.size();
+		for(int j = 0; j < chunk.chunk_alphabet.size(); ++j){
+			const string& name = chunk.chunk_alphabet.get_name(j);
+			chunk.symbol_numbers.push_back(add_symbol(name.data(), name.size()));
+		}
+#ifdef RTI_WIDE
+		for(int j = 0; j < chunk.chunk_times.size(); ++j)
+			chunk.time_numbers.push_back(add_time(chunk.chunk_times.get_value(j)));
+#endif
+		time_points.insert(chunk.time_points);
+		chunk.time_points = time_point_set();
 	}
-	int number = 0;
-	int iq25 = (int)(((double)time_points.size()) / 4.0);
-	int iq50 = (int)(((double)time_points.size()) / 2.0);
-	int iq75 = (int)(((double)time_points.size() * 3.0) / 4.0);
-	for(set<int>::iterator it = time_points.begin(); it != time_points.end(); ++it){
-		if(number == iq25) TIME_IQR25 = *it;
-		if(number == iq50) TIME_IQR50 = *it;
-		if(number == iq75) TIME_IQR75 = *it;
-		if(*it > time_sup) time_sup = *it;
-		number++;
+	if(line != num_words) input_error(STRING_COUNT_ERROR);
+	
+	reserve_arena(position, 0);
+	vector<long long> offsets(num_words + 1);
+	offsets[num_words] = position;
+	fill_chunk_task fill_task(chunks, arena, arena + arena_capacity, &offsets[0], num_words);
+	parallel_for(num_chunks, fill_task);
+	set_word_columns(arena, arena + arena_capacity, &offsets[0]);
+	rank_time_values();
+	
+	set_time_points(time_points);
+};
+
+/* sets the histogram cut points to the quantiles of the distinct time values */
+void timed_input::set_time_points(time_point_set& time_points){
+	rti_time* cut_points = new rti_time[NUM_HISTOGRAM_BARS - 1];
+	for(int i = 0; i < NUM_HISTOGRAM_BARS - 1; ++i) cut_points[i] = 0;
+	time_points.get_cut_points(NUM_HISTOGRAM_BARS - 1, cut_points, MAX_TIME);
+	set_time_cut_points(cut_points);
+	delete[] cut_points;
+};
+
+void set_time_cut_points(const rti_time* cut_points){
+	delete[] TIME_CUT_POINTS;
+	TIME_CUT_POINTS = new rti_time[NUM_HISTOGRAM_BARS - 1];
+	for(int i = 0; i < NUM_HISTOGRAM_BARS - 1; ++i)
+		TIME_CUT_POINTS[i] = cut_points[i];
+	if(NUM_HISTOGRAM_BARS == 4){
+		TIME_IQR25 = TIME_CUT_POINTS[0];
+		TIME_IQR50 = TIME_CUT_POINTS[1];
+		TIME_IQR75 = TIME_CUT_POINTS[2];
 	}
-	MAX_TIME = time_sup;
 };
 
-timed_input::~timed_input(){
+void time_point_set::insert(const time_point_set& other){
+	if(other.bitmap.size() > bitmap.size()) bitmap.resize(other.bitmap.size(), 0);
+	for(unsigned int i = 0; i < other.bitmap.size(); ++i)
+		bitmap[i] |= other.bitmap[i];
+	large_values.insert(large_values.end(), other.large_values.begin(), other.large_values.end());
+};
+
+static inline unsigned int radix_digit(rti_time value, int shift){
+	static const unsigned long long sign_bit = 1ULL << (8 * sizeof(rti_time) - 1);
+	return (((unsigned long long)value ^ sign_bit) >> shift) & 0xff;
+};
+
+/* LSD radix sort (on the sign flipped values, so negative values come first), then removes duplicates */
+void time_point_set::sort_large_values(){
+	vector<rti_time> buffer(large_values.size());
+	for(int shift = 0; shift < 8 * (int)sizeof(rti_time); shift += 8){
+		long long counts[257] = { 0 };
+		for(unsigned int i = 0; i < large_values.size(); ++i)
+			counts[radix_digit(large_values[i], shift) + 1]++;
+		for(int i = 0; i < 256; ++i) counts[i + 1] += counts[i];
+		for(unsigned int i = 0; i < large_values.size(); ++i)
+			buffer[counts[radix_digit(large_values[i], shift)]++] = large_values[i];
+		large_values.swap(buffer);
+	}
+	large_values.erase(unique(large_values.begin(), large_values.end()), large_values.end());
+};
+
+long long time_point_set::size(){
+	sort_large_values();
+	long long result = large_values.size();
+	for(unsigned int i = 0; i < bitmap.size(); ++i)
+		result += __builtin_popcountll(bitmap[i]);
+	return result;
+};
+
+void time_point_set::get_cut_points(int num_cut_points, rti_time* cut_points, rti_time& max_value){
+	long long num_values = size();
+	if(num_values == 0){
+		max_value = -1;
+		return;
+	}
+	
+	/* the distinct values in sorted order are: the negative large values, the bitmap, the other large values */
+	unsigned int num_negative = lower_bound(large_values.begin(), large_values.end(), 0) - large_values.begin();
+	long long rank = 0;
+	unsigned int block = 0;
+	int bit = 0;
+	for(int i = 1; i <= num_cut_points; ++i){
+		long long cut_rank = (long long)(((double)num_values * (double)i) / (double)(num_cut_points + 1));
+		if(cut_rank < num_negative){
+			cut_points[i - 1] = large_values[cut_rank];
+			continue;
+		}
+		if(rank < num_negative) rank = num_negative;
+		/* continue the bitmap scan from the previous cut point */
+		for(; block < bitmap.size(); ++block, bit = 0){
+			unsigned long long bits = bitmap[block] >> bit;
+			long long count = __builtin_popcountll(bits);
+			if(rank + count > cut_rank){
+				for(;; ++bit, bits >>= 1){
+					if(bits & 1ULL){
+						if(rank == cut_rank) break;
+						++rank;
+					}
+				}
+				break;
+			}
+			rank += count;
+		}
+		if(block < bitmap.size())
+			cut_points[i - 1] = ((rti_time)block << 6) + bit;
+		else
+			cut_points[i - 1] = large_values[cut_rank - rank + num_negative];
+	}
+	int last = bitmap.size() - 1;
+	while(last >= 0 && bitmap[last] == 0ULL) --last;
+	if(large_values.size() > num_negative || last < 0)
+		max_value = large_values.back();
+	else
+		max_value = ((rti_time)last << 6) + 63 - __builtin_clzll(bitmap[last]);
+};
+
+static inline unsigned long long hash_word(const timed_word* word){
+	unsigned long long h = 14695981039346656037ULL ^ (unsigned long long)word->get_length();
+	for(int index = 0; index < word->get_length(); ++index){
+		h = (h ^ (unsigned int)word->get_symbols()[index]) * 1099511628211ULL;
+		h = (h ^ (unsigned int)word->get_time_values()[index]) * 1099511628211ULL;
+	}
+	return h;
+};
+
+static inline bool equal_words(const timed_word* a, const timed_word* b){
+	if(a->get_length() != b->get_length()) return false;
+	return memcmp(a->get_symbols(), b->get_symbols(), a->get_length() * sizeof(int)) == 0
+	    && memcmp(a->get_time_values(), b->get_time_values(), a->get_length() * sizeof(int)) == 0;
+};
+
+/* replaces identical timed strings by a single word with their count, keeping the first occurrences in order */
+void timed_input::collapse_duplicates(){
+	unsigned int table_size = 16;
+	while(table_size < 2 * (unsigned int)num_words) table_size *= 2;
+	vector<int> table(table_size, -1);
+	
+	int num_distinct = 0;
+	for(int line = 0; line < num_words; ++line){
+		timed_word* word = &words[line];
+		unsigned int slot = hash_word(word) & (table_size - 1);
+		while(table[slot] != -1 && !equal_words(&words[table[slot]], word))
+			slot = (slot + 1) & (table_size - 1);
+		
+		if(table[slot] == -1){
+			table[slot] = num_distinct;
+			words[num_distinct++] = *word;
+		} else {
+			words[table[slot]].count += word->count;
+		}
+	}
+	if(num_distinct != num_words)
+		cerr << "collapsed " << num_words << " strings into " << num_distinct << " distinct strings" << endl;
+	num_words = num_distinct;
+	pack_arena();
+};
+
+rti_count timed_input::get_num_strings() const{
+	rti_count result = 0;
 	for(int line = 0; line < num_words; ++line)
-		delete words[line];
+		result += words[line].count;
+	return result;
+};
+
+timed_input::~timed_input(){
 	delete[] words;
-	delete[] alphabet;
+	free(arena);
+	if(mapped_data != 0) munmap(mapped_data, mapped_size);
+};
+
+static inline long long align_offset(long long offset){
+	return (offset + 7) & ~7LL;
+};
+
+/* points the words straight into the columns of a mapped binary dataset,
+ * returns false if the data is not in the binary format, stops if it is a binary dataset that cannot be read */
+bool timed_input::map_binary(const char* data, long long size){
+	if(size < (long long)strlen(TIMED_DATA_MAGIC) || memcmp(data, TIMED_DATA_MAGIC, strlen(TIMED_DATA_MAGIC)) != 0) return false;
+	const timed_data_header* header = (const timed_data_header*)data;
+	if(size < (long long)sizeof(timed_data_header) || header->version != TIMED_DATA_VERSION || header->file_size != size)
+		input_error("unsupported or corrupt binary dataset");
+	if(header->wide != WIDE_BUILD)
+		input_error("binary dataset written by a build with a different RTI_WIDE setting, convert it again");
+	
+	initialize(header->num_words, header->alph_size);
+	const char* name = data + header->alphabet_offset;
+	const char* names_end = name + header->alphabet_bytes;
+	while(name < names_end){
+		int length = strlen(name);
+		add_symbol(name, length);
+		name += length + 1;
+	}
+	
+	MAX_TIME = header->max_time;
+	
+#ifdef RTI_WIDE
+	const rti_time* time_values = (const rti_time*)(data + header->time_table_offset);
+	sorted_time_values.assign(time_values, time_values + header->num_time_values);
+	TIME_VALUES = sorted_time_values.empty() ? 0 : &sorted_time_values[0];
+#endif
+	const rti_count* counts = (const rti_count*)(data + header->counts_offset);
+	set_word_columns((int*)(data + header->symbols_offset), (int*)(data + header->time_values_offset),
+	                 (const long long*)(data + header->word_offsets_offset));
+	for(int line = 0; line < num_words; ++line){
+		words[line].count = counts[line];
+		TOTAL_NUM_SYMBOLS += words[line].length * words[line].count;
+	}
+	
+	if(header->num_cut_points == NUM_HISTOGRAM_BARS - 1){
+		set_time_cut_points((const rti_time*)(data + header->cut_points_offset));
+	} else {
+		/* written with a different number of histogram bars, recompute them from the time column */
+		time_point_set time_points;
+		for(int line = 0; line < num_words; ++line)
+			for(int index = 0; index < words[line].length; ++index)
+				time_points.insert(words[line].get_time_value(index));
+		set_time_points(time_points);
+	}
+	return true;
+};
+
+/* pads the file with zeros up to offset, then writes size bytes of data */
+static void write_section(FILE* file, long long& position, long long offset, const void* data, long long size){
+	assert(offset >= position);
+	for(; position < offset; ++position) fputc(0, file);
+	if(size > 0) fwrite(data, 1, size, file);
+	position += size;
+};
+
+bool timed_input::write_binary(const char* file_name) const{
+	timed_data_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TIMED_DATA_MAGIC, sizeof(header.magic));
+	header.version = TIMED_DATA_VERSION;
+	header.num_words = num_words;
+	header.alph_size = alph_size;
+	header.num_cut_points = NUM_HISTOGRAM_BARS - 1;
+	header.max_time = MAX_TIME;
+	header.wide = WIDE_BUILD;
+#ifdef RTI_WIDE
+	header.num_time_values = sorted_time_values.size();
+#endif
+	for(int line = 0; line < num_words; ++line)
+		header.total_symbols += words[line].length;
+	long long column_size = header.total_symbols + num_words;
+	string names;
+	for(int i = 0; i < alphabet.size(); ++i){
+		names += alphabet.get_name(i);
+		names += '\0';
+	}
+	header.alphabet_bytes = names.size();
+	
+	header.alphabet_offset     = align_offset(sizeof(header));
+	header.cut_points_offset   = align_offset(header.alphabet_offset + header.alphabet_bytes);
+	header.word_offsets_offset = align_offset(header.cut_points_offset + header.num_cut_points * sizeof(rti_time));
+	header.symbols_offset      = align_offset(header.word_offsets_offset + (num_words + 1) * sizeof(long long));
+	header.time_values_offset  = align_offset(header.symbols_offset + column_size * sizeof(int));
+	header.counts_offset       = align_offset(header.time_values_offset + column_size * sizeof(int));
+	header.time_table_offset   = align_offset(header.counts_offset + num_words * sizeof(rti_count));
+	header.file_size           = align_offset(header.time_table_offset + header.num_time_values * sizeof(rti_time));
+	
+	FILE* file = fopen(file_name, "wb");
+	if(file == 0) return false;
+	
+	long long position = 0;
+	write_section(file, position, 0, &header, sizeof(header));
+	write_section(file, position, header.alphabet_offset, names.data(), header.alphabet_bytes);
+	write_section(file, position, header.cut_points_offset, TIME_CUT_POINTS, header.num_cut_points * sizeof(rti_time));
+	
+	write_section(file, position, header.word_offsets_offset, 0, 0);
+	long long offset = 0;
+	for(int line = 0; line <= num_words; ++line){
+		write_section(file, position, position, &offset, sizeof(offset));
+		if(line < num_words) offset += words[line].length + 1;
+	}
+	
+	write_section(file, position, header.symbols_offset, 0, 0);
+	for(int line = 0; line < num_words; ++line)
+		write_section(file, position, position, words[line].symbols, (words[line].length + 1) * sizeof(int));
+	
+	write_section(file, position, header.time_values_offset, 0, 0);
+	for(int line = 0; line < num_words; ++line)
+		write_section(file, position, position, words[line].time_values, (words[line].length + 1) * sizeof(int));
+	
+	write_section(file, position, header.counts_offset, 0, 0);
+	for(int line = 0; line < num_words; ++line)
+		write_section(file, position, position, &words[line].count, sizeof(rti_count));
+	
+#ifdef RTI_WIDE
+	write_section(file, position, header.time_table_offset, TIME_VALUES, header.num_time_values * sizeof(rti_time));
+#endif
+	
+	write_section(file, position, header.file_size, 0, 0);
+	
+	return fclose(file) == 0;
 };
 
 const string timed_input::to_str() const{
   ostringstream ostr;
-	ostr << num_words  << " " << alph_size << "\n";
+	ostr << get_num_strings() << " " << alph_size << "\n";
 	for(int line = 0; line < num_words; ++line)
+	for(rti_count copy = 0; copy < words[line].count; ++copy)
 	{
-	    timed_word* word = words[line];
+	    timed_word* word = &words[line];
 	    ostr << word->length << " ";
 	    for(int index = 0; index < word->length; ++index)
 	    {
-	      ostr << word->char_symbols[index] << " ";
-	      ostr << word->time_values[index] << " ";
+	      ostr << alphabet.get_name(word->symbols[index]) << " ";
+	      ostr << word->get_time_value(index) << " ";
 			}
 			ostr << "\n";
 	  }
@@ -134,7 +935,57 @@ const string timed_input::to_str() const{
 timed_word::timed_word(){
 	symbols = 0;
 	time_values = 0;
-	char_symbols = 0;
 	length = 0;
+	count = 1;
+};
+
+time_table::time_table(){
+	table.assign(16, -1);
+};
+
+int time_table::insert(rti_time value){
+	unsigned int mask = table.size() - 1;
+	unsigned int slot = hash(value) & mask;
+	for(; table[slot] != -1; slot = (slot + 1) & mask)
+		if(values[table[slot]] == value) return table[slot];
+	
+	int number = values.size();
+	values.push_back(value);
+	if(2 * values.size() > table.size()){
+		table.assign(2 * table.size(), -1);
+		for(int i = 0; i < (int)values.size(); ++i){
+			unsigned int slot = hash(values[i]) & (table.size() - 1);
+			while(table[slot] != -1) slot = (slot + 1) & (table.size() - 1);
+			table[slot] = i;
+		}
+	} else {
+		table[slot] = number;
+	}
+	return number;
+};
+
+symbol_table::symbol_table(){
+	table.assign(16, -1);
+};
+
+int symbol_table::insert(const char* name, int length){
+	int number = find(name, length);
+	if(number != -1) return number;
+	
+	number = names.size();
+	names.push_back(string(name, length));
+	if(2 * names.size() > table.size()){
+		table.assign(2 * table.size(), -1);
+		for(int i = 0; i < (int)names.size(); ++i){
+			unsigned int slot = hash(names[i].data(), names[i].size()) & (table.size() - 1);
+			while(table[slot] != -1) slot = (slot + 1) & (table.size() - 1);
+			table[slot] = i;
+		}
+	} else {
+		unsigned int slot = hash(name, length) & (table.size() - 1);
+		while(table[slot] != -1) slot = (slot + 1) & (table.size() - 1);
+		table[slot] = number;
+	}
+	return number;
 };
 
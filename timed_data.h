@@ -7,6 +7,10 @@
  *  int char int char int char int ... char int				(length_of_string symbol1 time_delay1 s2 t2 .. sn tn)
  *
  *  All ints are positive integers, greater or equal to 0
+ *  A symbol can be any string without whitespace, symbols are numbered in order of their first occurrence
+ *
+ *  The same data can be stored in a binary columnar format (written by rti_convert), 
+ *  which is mapped into memory and used without parsing, see timed_data_header below.
  *
  *  For some info regarding the algorithm, see:
  *  Sicco Verwer and Mathijs de Weerdt and Cees Witteveen (2007),
@@ -33,68 +37,198 @@
 
 class timed_input;
 class timed_word;
+struct parse_chunk;
+
+/* Building with -DRTI_WIDE (make wide) makes time values and counts 64-bit, for datasets whose 
+ * time values, time sums or number of strings do not fit in an int. The time columns then store
+ * the rank of every time value among the distinct time values (TIME_VALUES), so they stay 32-bit. */
+#ifdef RTI_WIDE
+typedef long long rti_time;
+typedef long long rti_count;
+#else
+typedef int rti_time;
+typedef int rti_count;
+#endif
 
 extern int MAX_SYMBOL;
-extern int MIN_TIME;
-extern int MAX_TIME;
+extern rti_time MIN_TIME;
+extern rti_time MAX_TIME;
 extern int NUM_HISTOGRAM_BARS;
 extern int NUM_WORDS;
-extern int TOTAL_NUM_SYMBOLS;
+extern long long TOTAL_NUM_SYMBOLS;
+
+/* the NUM_HISTOGRAM_BARS - 1 upper bounds (inclusive) of the time histogram bars,
+ * these are the quantiles of the distinct time values, for 4 bars the interquartile ranges */
+extern rti_time* TIME_CUT_POINTS;
+extern rti_time TIME_IQR25;
+extern rti_time TIME_IQR50;
+extern rti_time TIME_IQR75;
 
-extern int TIME_IQR25;
-extern int TIME_IQR50;
-extern int TIME_IQR75;
+#ifdef RTI_WIDE
+/* the distinct time values in increasing order, indexed by the entries of the time columns */
+extern const rti_time* TIME_VALUES;
+#endif
+
+extern long long MIN_PARALLEL_PARSE_SIZE;
+
+/* prints why the input cannot be read and exits */
+extern void input_error(const char* message);
 
 #include <istream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
 using namespace std;
 
-class timed_input{
-	char* alphabet;
-	timed_word** words;
+/* Binary dataset format, all sections are 8-byte aligned and in native byte order:
+ *  timed_data_header
+ *  char      alphabet[alphabet_bytes]               (the symbol names, each ended by '\0')
+ *  rti_time  time_cut_points[num_cut_points]        (TIME_CUT_POINTS)
+ *  long long word_offsets[num_words + 1]            (start of every word in the columns)
+ *  int       symbols[num_words + total_symbols]     (every word ends with the end symbol num_words)
+ *  int       time_values[num_words + total_symbols] (every word ends with the sum of its time values,
+ *                                                    wide: the ranks in time_table, every word ends with -1)
+ *  rti_count counts[num_words]                      (the number of occurrences of every (distinct) word)
+ *  rti_time  time_table[num_time_values]            (wide only: TIME_VALUES)
+ * a file can only be read by a build with the same RTI_WIDE setting
+ */
+#define TIMED_DATA_MAGIC "RTI-COL"
+#define TIMED_DATA_VERSION 4
+
+struct timed_data_header{
+	char magic[8];
+	int version;
 	int num_words;
 	int alph_size;
+	int num_cut_points;
+	long long total_symbols;
+	long long max_time;
+	int wide;
+	int num_time_values;
+	long long alphabet_bytes;
+	long long alphabet_offset;
+	long long cut_points_offset;
+	long long word_offsets_offset;
+	long long symbols_offset;
+	long long time_values_offset;
+	long long counts_offset;
+	long long time_table_offset;
+	long long file_size;
+};
+
+/* The set of distinct time values, used to compute the histogram cut points in linear time.
+ * Values below BITMAP_SIZE are kept in a bitmap, the others in a list that is 
+ * radix sorted once when the cut points are computed. */
+class time_point_set{
+	static const int BITMAP_SIZE = 1 << 26;
 	
-public:
-	timed_input();
-	timed_input(istream& str);
-	~timed_input();
+	vector<unsigned long long> bitmap;
+	vector<rti_time> large_values;
+	
+	void sort_large_values();
 
-	const string to_str() const;
+public:
+	inline void insert(rti_time value){
+		if(value >= 0 && value < BITMAP_SIZE){
+			unsigned int block = (unsigned int)value >> 6;
+			if(block >= bitmap.size()) bitmap.resize(block + 1 + (block >> 1), 0);
+			bitmap[block] |= 1ULL << (value & 63);
+		} else {
+			large_values.push_back(value);
+		}
+	};
+	
+	/* adds all values of other */
+	void insert(const time_point_set& other);
+	
+	/* the number of distinct values */
+	long long size();
+	
+	/* the values at ranks (size() * i) / (num_cut_points + 1), i = 1..num_cut_points, 
+	 * and the largest value (-1 if there are none) */
+	void get_cut_points(int num_cut_points, rti_time* cut_points, rti_time& max_value);
+};
 
-	/* get methods */
-	inline char get_symbol(int i) const{
-		if(i < alph_size)
-			return alphabet[i];
-		return '\0';
+/* Maps symbol names to dense numbers (in order of insertion) and back,
+ * uses open addressing on the names, so both directions take O(1) */
+class symbol_table{
+	vector<string> names;
+	vector<int> table;     // symbol number or -1, size is a power of 2
+	
+	static inline unsigned int hash(const char* name, int length){
+		unsigned int h = 2166136261u;
+		for(int i = 0; i < length; ++i){
+			h ^= (unsigned char)name[i];
+			h *= 16777619u;
+		}
+		return h;
+	};
+	
+	inline bool equals(int number, const char* name, int length) const{
+		return (int)names[number].size() == length && names[number].compare(0, length, name, length) == 0;
 	};
 	
-	inline int get_int(char c) const{
-		for(int i = 0; i < alph_size; ++i)
-			if(alphabet[i] == c) return i;
+public:
+	symbol_table();
+	
+	/* returns the number of name, -1 if it is not in the table */
+	inline int find(const char* name, int length) const{
+		unsigned int mask = table.size() - 1;
+		for(unsigned int slot = hash(name, length) & mask; table[slot] != -1; slot = (slot + 1) & mask)
+			if(equals(table[slot], name, length)) return table[slot];
 		return -1;
 	};
-
-	inline timed_word* get_word(int i) const{
-		return words[i];
+	
+	inline int find(const string& name) const{
+		return find(name.data(), name.size());
 	};
 	
-	inline int get_num_words() const{
-		return num_words;
+	/* returns the number of name, adds it to the table if it is new */
+	int insert(const char* name, int length);
+	
+	inline const string& get_name(int number) const{
+		return names[number];
+	};
+	
+	inline int size() const{
+		return names.size();
 	};
+};
 
-	inline int get_alph_size() const{
-		return alph_size;
+/* Maps the time values to dense numbers (in order of insertion), 
+ * used to rank compress the time columns of the wide build */
+class time_table{
+	vector<rti_time> values;
+	vector<int> table;     // time number or -1, size is a power of 2
+	
+	static inline unsigned int hash(rti_time value){
+		unsigned long long h = (unsigned long long)value * 0x9E3779B97F4A7C15ULL;
+		return (unsigned int)(h >> 32);
+	};
+	
+public:
+	time_table();
+	
+	/* returns the number of value, adds it to the table if it is new */
+	int insert(rti_time value);
+	
+	inline rti_time get_value(int number) const{
+		return values[number];
+	};
+	
+	inline int size() const{
+		return values.size();
 	};
 };
 
+void set_time_cut_points(const rti_time* cut_points);
+
 class timed_word{
 	int*	symbols;
 	int*	time_values;
-	char*	char_symbols;
 	int		length;
+	rti_count	count;
 	double	probability;
 
 	friend class timed_input;
@@ -106,18 +240,28 @@ public:
 		return symbols;
 	};
 	
-	inline const char* get_char_symbols() const{
-		return char_symbols;
-	};
-
+	/* the time column of the word, ranks in TIME_VALUES in the wide build */
 	inline const int* get_time_values() const{
 		return time_values;
 	};
 	
+	inline rti_time get_time_value(int index) const{
+#ifdef RTI_WIDE
+		return TIME_VALUES[time_values[index]];
+#else
+		return time_values[index];
+#endif
+	};
+	
 	inline const int get_length() const{
 		return length;
 	};
 	
+	/* the number of identical timed strings in the input */
+	inline const rti_count get_count() const{
+		return count;
+	};
+	
 	inline const double get_probability(){
 		return probability;
 	};
@@ -127,5 +271,86 @@ public:
 	};
 };
 
+class timed_input{
+	symbol_table alphabet;
+	timed_word* words;
+	int num_words;
+	int alph_size;
+	
+	/* one block with the symbols of all words back to back, followed by their time values,
+	 * every word ends with its end symbol and the sum of its time values (not used for mapped files) */
+	int* arena;
+	long long arena_capacity;
+	void reserve_arena(long long size, long long used);
+	void pack_arena();
+	void set_word_columns(int* symbols, int* time_values, const long long* offsets);
+	
+	/* wide build: the time values numbered in order of first occurrence, until rank_time_values
+	 * replaces these numbers in the time columns by ranks in sorted_time_values (TIME_VALUES) */
+	time_table time_numbers;
+	vector<rti_time> sorted_time_values;
+	inline int add_time(rti_time value);
+	void rank_time_values();
+
+	/* shared by the stream and the mapped file parsers */
+	void initialize(int n, int a);
+	int add_symbol(const char* name, int length);
+	void read_stream(istream& str);
+	void parse_buffer(const char* begin, const char* end);
+	void parse_buffer_parallel(const char* begin, const char* end);
+	void add_chunks(vector<parse_chunk>& chunks, const char* begin, const char* end, int num_chunks);
+	void parse_chunks(vector<parse_chunk>& chunks);
+	void set_time_points(time_point_set& time_points);
+	bool map_binary(const char* begin, long long size);
+	void collapse_duplicates();
+	
+	/* the mapped binary dataset, the words point into it */
+	void* mapped_data;
+	long long mapped_size;
+	
+public:
+	timed_input();
+	timed_input(istream& str);
+	/* maps the file into memory and parses it without iostreams, 
+	 * files larger than MIN_PARALLEL_PARSE_SIZE are split into chunks (at line ends) that are parsed by NUM_THREADS threads,
+	 * falls back to reading it as a stream when it cannot be mapped */
+	timed_input(const char* file_name);
+	/* parses several text files as one input, as if their strings (without the headers) were in one file,
+	 * the files are split into chunks that are parsed by NUM_THREADS threads */
+	timed_input(const vector<const char*>& file_names);
+	/* builds the input from words given as columns, such as the sessions of an event_log,
+	 * symbols are numbers in names, the result is the same as parsing the words written as text */
+	timed_input(const symbol_table& names, const vector<int>& lengths, const vector<int>& symbols, const vector<rti_time>& time_values);
+	~timed_input();
+
+	const string to_str() const;
+	/* writes the binary columnar format, returns false on failure */
+	bool write_binary(const char* file_name) const;
+
+	/* get methods */
+	inline const string& get_symbol(int i) const{
+		return alphabet.get_name(i);
+	};
+	
+	inline int get_int(const string& name) const{
+		return alphabet.find(name);
+	};
+
+	inline timed_word* get_word(int i) const{
+		return &words[i];
+	};
+	
+	/* the number of distinct words, every word has a count of its occurrences */
+	inline int get_num_words() const{
+		return num_words;
+	};
+	
+	rti_count get_num_strings() const;
+
+	inline int get_alph_size() const{
+		return alph_size;
+	};
+};
+
 
 #endif /* _TIMED_DATA_H_*/
@@ -0,0 +1,79 @@
+/*
+ *  RTI (real-time inference)
+ *  Traversal.h, the header file for the depth first traversals of the subtrees of the states
+ *
+ *  The merges, splits and tests visit a subtree (or two subtrees together) state by state. A recursion
+ *  uses stack for every level of the subtree, which is as deep as the longest string. A traversal keeps
+ *  the items it still has to visit (states, pairs of states or intervals) on a work stack instead. There is
+ *  a work stack for every item type and thread, it is reused by all traversals of that type, so it is only
+ *  allocated once (the threads of parallel_for are kept between calls, see parallel.h). A traversal can
+ *  be started while another one is visiting an item, it works above the items of the other one and pops
+ *  all its own items before it returns.
+ *
+ *  Copyright 2009 - Sicco Verwer, jan-2009
+ *  This program is released under the GNU General Public License
+ *  Info online: http://www.gnu.org/licenses/quick-guide-gplv3.html
+ *  Or in the file: licence.txt
+ *  For information/questions contact: siccoverwer@gmail.com
+ *
+ *  Feel free to adapt the code to your needs, please inform me of (potential) improvements.
+ */
+
+#ifndef _TRAVERSAL_H_
+#define _TRAVERSAL_H_
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+template <class T> class traversal{
+	/* the items to visit, the flag is set for an item that has been entered and is waiting to be left */
+	static inline vector< pair<T, bool> >& work(){
+		static thread_local vector< pair<T, bool> > stack;
+		return stack;
+	};
+
+public:
+	/* adds a child of the item that is entered, it is visited after the item returns */
+	static inline void push(const T& item){
+		work().push_back(pair<T, bool>(item, false));
+	};
+
+	/* visits root and the items pushed by enter in the order of a recursion: enter(item) pushes the children of item,
+	 * they are visited in the order in which they were pushed, every one together with its children before the next */
+	template <class E> static void run(const T& root, E enter){
+		vector< pair<T, bool> >& stack = work();
+		unsigned int base = stack.size();
+		stack.push_back(pair<T, bool>(root, false));
+		while(stack.size() > base){
+			T item = stack.back().first;
+			stack.pop_back();
+			unsigned int top = stack.size();
+			enter(item);
+			reverse(stack.begin() + top, stack.end());
+		}
+	};
+
+	/* the same, leave(item) is called after all children of item have been visited */
+	template <class E, class L> static void run(const T& root, E enter, L leave){
+		vector< pair<T, bool> >& stack = work();
+		unsigned int base = stack.size();
+		stack.push_back(pair<T, bool>(root, false));
+		while(stack.size() > base){
+			if(stack.back().second){
+				T item = stack.back().first;
+				stack.pop_back();
+				leave(item);
+				continue;
+			}
+			stack.back().second = true;
+			T item = stack.back().first;
+			unsigned int top = stack.size();
+			enter(item);
+			reverse(stack.begin() + top, stack.end());
+		}
+	};
+};
+
+#endif /* _TRAVERSAL_H_ */